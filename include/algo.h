@@ -9,247 +9,624 @@
 #include <time.h>
 #include <math.h>
 #include "oracle.h"
+#include "packed.h"
+#include "qtable.h"
+#include "samples.h"
+#include "simd.h"
+#include "checkpoint.h"
+#include "priority.h"
 using namespace std;
 
 extern pthread_mutex_t writelock;
+extern pthread_barrier_t barrier;
 
+// The algorithms are templates over the sample oracle, so its calls are inlined into
+// the sampling loops. An Oracle class (see Sailing in oracle.h) provides, with states
+// indexed by state_t (util.h)
+//   void setValues(Params* params)                           set up from params, reseed randomly
+//   void seed(uint64_t seed, uint64_t stream)                reseed with stream `stream` of seed
+//   state_t localUniformInt(state_t, state_t), double localUniformDouble(double, double)
+//   state_t numStates(), int numActions()                    size of the MDP
+//   state_t originalIndex(state_t i)                         index of state i in the problem's own order
+//   void SO(state_t i, int a, state_t& j, double& r)         one sample of (i, a)
+//   void SO(state_t i, int a, int m, state_t* j, double* r)  m samples of (i, a)
+//   void SO(const state_t* i, const int* a, int n, state_t* j, double* r)   one sample per pair
+//   double test(std::vector<action_t>* pi, Params* params)   evaluate and print policy pi
+
+// lock writelock; the time spent waiting when it is contended is added to
+// params->lock_wait, which is itself guarded by writelock
+void lockWrite(Params* params){
+	if(pthread_mutex_trylock(&writelock) == 0)
+		return;
+	PROF_START(t);
+	double start = get_wall_time();
+	pthread_mutex_lock(&writelock);
+	params->lock_wait += get_wall_time() - start;
+	PROF_STOP(t, PROF_LOCK_TICKS);
+}
+
+// contiguous block [lo, hi) of states swept by thread_id in VRVI and VRQVI
+void stateBlock(int thread_id, Params* params, state_t* lo, state_t* hi){
+	*lo = (state_t)((long long)params->len_state * thread_id / params->total_num_threads);
+	*hi = (state_t)((long long)params->len_state * (thread_id + 1) / params->total_num_threads);
+}
+
+template <class Oracle = Sailing>
 class QVI{
 	private: // local variables for each thread
-		int init_state;
+		state_t init_state;
 		int init_action;
-		int next_state;
+		state_t next_state;
 		double r;
 		double S;
-		Sailing s;
+		Oracle s;
+		std::vector<state_t> next_buf;   // next states of the max_inner_iter samples
+		std::vector<double> r_buf;       // rewards of the max_inner_iter samples
+		state_t shard_lo;                // states [shard_lo, shard_lo+shard_len) are sampled
+		state_t shard_len;
+		state_t sweep_state;             // state swept by sweepStates
 			
 	public:  // global variables shared by all threads
-		std::vector<double>* V;
-		std::vector<int>* pi;
+		std::vector<value_t>* V;
+		std::vector<action_t>* pi;
 		Params* params;
+		PackedTable* table;  // lock-free V and pi, used instead of writelock if not NULL
+		PrioritySweep* sweep;  // schedule of style 3, NULL otherwise
+		long long improved;    // raises of V by this copy since the convergence monitor took them
+		double max_change;     // largest of these raises
 	
 		// constructor
-		QVI(std::vector<double>* V_, std::vector<int>* pi_, Params* params_){
+		QVI(std::vector<value_t>* V_, std::vector<action_t>* pi_, Params* params_, PackedTable* table_ = NULL,
+		    PrioritySweep* sweep_ = NULL){
 			V = V_;
 			pi = pi_;
 			params = params_;
+			table = table_;
+			sweep = sweep_;
+			sweep_state = 0;
+			improved = 0;
+			max_change = 0.;
 			init_state = 0;
 			init_action = 0;
+			shard_lo = 0;
+			shard_len = params->len_state;
 			s.setValues(params);
+			next_buf.resize(params->max_inner_iter);
+			r_buf.resize(params->max_inner_iter);
 		}
 		
 		// update global variables
-		void update(int iter){
+		void update(long long iter){
 			
+			PROF_START(t);
+			PROF_COUNT(PROF_UPDATES, 1);
 			// select (state, action) uniformly random
 			if(params->style == 0){
-				init_state = uniformInt(0, params->len_state-1);
-				init_action = uniformInt(0, params->len_action-1);
+				init_state = s.localUniformInt(shard_lo, shard_lo+shard_len-1);
+				init_action = s.localUniformInt(0, params->len_action-1);
+			}
+			// action iter of the state chosen by prioritized sweeping
+			else if(params->style == 3){
+				init_state = sweep_state;
+				init_action = (int)(iter % params->len_action);
 			}
 			// select (state, action) globally cyclic
 			else{
-				init_state = (iter/params->len_action) % params->len_state;
-				init_action = iter % params->len_action;
+				init_state = shard_lo + (state_t)((iter/params->len_action) % shard_len);
+				init_action = (int)(iter % params->len_action);
 			}
 			
+			publish(init_state, sampleQ(init_state, init_action), init_action);
+			PROF_STOP(t, PROF_UPDATE_TICKS);
+		}
+		
+		// update all actions of one state and write V and pi once (-statewise): the state is
+		// chosen as in update, its actions are sampled locally and only the best one is published
+		void updateState(long long iter){
+			
+			PROF_START(t);
+			PROF_COUNT(PROF_UPDATES, params->len_action);
+			if(params->style == 0)
+				init_state = s.localUniformInt(shard_lo, shard_lo+shard_len-1);
+			else if(params->style == 3)
+				init_state = sweep_state;
+			else
+				init_state = shard_lo + (state_t)((iter/params->len_action) % shard_len);
+			
+			double best = -INFINITY;
+			init_action = 0;
+			for(int a = 0; a < params->len_action; a++){
+				double q = sampleQ(init_state, a);
+				if(q > best){
+					best = q;
+					init_action = a;
+				}
+			}
+			publish(init_state, best, init_action);
+			PROF_STOP(t, PROF_UPDATE_TICKS);
+		}
+		
+		// Q(i, a) estimated from max_inner_iter samples, lowered by the monotonicity margin
+		double sampleQ(state_t i, int a){
+			// call sample oracle once for all samples
+			s.SO(i, a, params->max_inner_iter, next_buf.data(), r_buf.data());
+			if(sweep)
+				sweep->observe(i, next_buf[0]);
 			S = 0.;
-			for (int i = 0; i < params->max_inner_iter; i++){
-				// call sample oracle
-				s.SO(init_state, init_action, next_state, r);
-				S += r + params->gamma * V->at(next_state);
+			for (int k = 0; k < params->max_inner_iter; k++){
+				S += r_buf[k] + params->gamma * (table ? table->getV(next_buf[k]) : V->at(next_buf[k]));
 			}
 			// averaged reward
 			S = S / params->max_inner_iter;
-			double newQ = S - (1-params->gamma)*params->epsilon/4.;
+			return S - (1-params->gamma)*params->epsilon/4.;
+		}
+		
+		// raise V[i] to newQ and set pi[i] = a if newQ is larger
+		void publish(state_t i, double newQ, int a){
+			
+			// update shared memory with an atomic max
+			if(table){
+				double old;
+				if(table->raise(i, newQ, a, &old)){
+					PROF_COUNT(PROF_IMPROVED, 1);
+					improved++;
+					max_change = max(max_change, newQ - old);
+				}
+				return;
+			}
 			
-			// update shared memory
-			pthread_mutex_lock(&writelock);
-			if (newQ > V->at(init_state)){
-				V->at(init_state) = newQ;
-				pi->at(init_state) = init_action;
+			// update shared memory with mutex, comparing in value_t so a raise lost to rounding is not counted
+			value_t q = (value_t)newQ;
+			lockWrite(params);
+			if (q > V->at(i)){
+				improved++;
+				max_change = max(max_change, (double)(q - V->at(i)));
+				V->at(i) = q;
+				pi->at(i) = a;
+				PROF_COUNT(PROF_IMPROVED, 1);
 			}
 			pthread_mutex_unlock(&writelock);
 		}
 		
+		// reseed the oracle of this copy with random stream `stream`
+		void seed(long long stream){
+			seedOracle(s, params, stream);
+		}
+		
+		// sample only states [lo, hi), the iteration counts the sweep of this range
+		void setShard(state_t lo, state_t hi){
+			shard_lo = lo;
+			shard_len = hi - lo;
+		}
+		
+		// prioritized sweeping: update every action of the states the schedule hands to
+		// thread_id, at least n updates, and requeue each state by how much V moved
+		void sweepStates(int thread_id, long long n){
+			for(long long k = 0; k < n; k += params->len_action){
+				sweep_state = sweep->pop(thread_id);
+				double before = table ? table->getV(sweep_state) : (*V)[sweep_state];
+				if(params->statewise)
+					updateState(0);
+				else
+					for(int a = 0; a < params->len_action; a++)
+						update(a);
+				sweep->done(sweep_state, (table ? table->getV(sweep_state) : (*V)[sweep_state]) - before);
+			}
+		}
+		
 		// evaluate current policy
 		void test(){
-			test_sailing(s, pi, params);
+			if(table)
+				table->unpack(table->mapped() ? NULL : V, pi);
+			s.test(pi, params);
+		}
+		
+		// copy current policy while other threads keep updating it
+		void snapshot(std::vector<action_t>* pi_copy){
+			if(table){
+				table->unpack(NULL, pi_copy);
+				return;
+			}
+			lockWrite(params);
+			*pi_copy = *pi;
+			pthread_mutex_unlock(&writelock);
+		}
+		
+		// evaluate a policy snapshot
+		void test(std::vector<action_t>* pi_copy){
+			s.test(pi_copy, params);
+		}
+		
+		// checkpoint: V, pi; with a store file its pages are only scheduled for writeback, V and pi stay
+		// there and the end of the run waits for them (run.h)
+		void save(Checkpoint* ck){
+			if(table && table->mapped()){
+				table->flush(false);
+				return;
+			}
+			ck->vectors.push_back(std::vector<value_t>(V->size()));
+			ck->pi.resize(pi->size());
+			if(table){
+				table->unpack(&ck->vectors[0], &ck->pi);
+				return;
+			}
+			lockWrite(params);
+			ck->vectors[0] = *V;
+			ck->pi = *pi;
+			pthread_mutex_unlock(&writelock);
+		}
+		
+		// a store file was opened with its contents kept: V and pi are already there, possibly
+		// raised after the checkpoint, which leaves them valid lower bounds
+		void load(const Checkpoint& ck){
+			if(table && table->mapped())
+				return;
+			*V = ck.vectors[0];
+			*pi = ck.pi;
+			if(table)
+				table->load(*V, *pi);
 		}
 };
 
-class Qlearning {
+template <class Oracle = Sailing>
+class Qlearning{
 	
 	private: // local variables for each thread
-		int init_state = 0;
+		state_t init_state = 0;
 		int init_action = 0;
-		int next_state = 0;
+		state_t next_state = 0;
 		double r = 0.;
-		Sailing s;
+		state_t sweep_state = 0;  // state swept by sweepStates
+		Oracle s;
 		
 	public:  // global variables shared by all threads
-		std::vector<std::vector<double>>* Q;
-		std::vector<double>* V;
-		std::vector<int>* pi;
+		QTable* Q;
+		std::vector<value_t>* V;
+		std::vector<action_t>* pi;
 		Params* params;
+		PackedTable* table;  // lock-free V and pi, used instead of writelock if not NULL
+		PrioritySweep* sweep;  // schedule of style 3, NULL otherwise
+		long long improved = 0;  // raises of V by this copy since the convergence monitor took them
+		double max_change = 0.;  // largest of these raises
 	
-		Qlearning(std::vector<std::vector<double>>* Q_, 
-				  std::vector<double>* V_, 
-				  std::vector<int>* pi_, 
-				  Params* params_){
+		Qlearning(QTable* Q_, 
+				  std::vector<value_t>* V_, 
+				  std::vector<action_t>* pi_, 
+				  Params* params_,
+				  PackedTable* table_ = NULL,
+				  PrioritySweep* sweep_ = NULL){
 			Q = Q_;
 			V = V_;
 			pi = pi_;
 			params = params_;
+			table = table_;
+			sweep = sweep_;
 			s.setValues(params);			
 		}
 		
 		// update global variables
-		void update(int iter){
+		void update(long long iter){
 			
+			PROF_START(t);
+			PROF_COUNT(PROF_UPDATES, 1);
 			// select (state, action) uniformly random
 			if(params->style == 0){
-				init_state = uniformInt(0, params->len_state-1); 
-				init_action = uniformInt(0, params->len_action-1);
+				init_state = s.localUniformInt(0, params->len_state-1); 
+				init_action = s.localUniformInt(0, params->len_action-1);
 			}
 			// select (state, action) globally cyclic 
 			else if(params->style == 1){
-				init_state = (iter/params->len_action) % params->len_state;
-				init_action = iter % params->len_action;
+				init_state = (state_t)((iter/params->len_action) % params->len_state);
+				init_action = (int)(iter % params->len_action);
+			}
+			// action iter of the state chosen by prioritized sweeping
+			else if(params->style == 3){
+				init_state = sweep_state;
+				init_action = (int)(iter % params->len_action);
 			}
 			// select (state, action) following a Markovian trajectory with some exploration
 			else{
 				init_state = next_state;
-				init_action = (*pi)[next_state];
-				if(uniformDouble(0.,1.) < params->explore)
-					init_action = uniformInt(0, params->len_action-1);
+				init_action = table ? table->getPi(next_state) : (*pi)[next_state];
+				if(s.localUniformDouble(0.,1.) < params->explore)
+					init_action = s.localUniformInt(0, params->len_action-1);
 			}
 			
 			// call sample oracle
 			s.SO(init_state, init_action, next_state, r);
+			if(sweep)
+				sweep->observe(init_state, next_state);
+			
+			// update global variables lock-free: the (s,a) entry of Q by compare-and-swap, as
+			// several threads can draw the same pair at once, V and pi by atomic max
+			if(table){
+				value_t q = Q->blend(init_state, init_action, params->alpha, r + params->gamma*table->getV(next_state));
+				double old;
+				if(table->raise(init_state, q, init_action, &old)){
+					PROF_COUNT(PROF_IMPROVED, 1);
+					improved++;
+					max_change = max(max_change, (double)q - old);
+				}
+				PROF_STOP(t, PROF_UPDATE_TICKS);
+				return;
+			}
 			
 			// update global variables with mutex
-			pthread_mutex_lock(&writelock);
+			lockWrite(params);
 			
 			// learning rate of Q-learning
 			//params->alpha = 1./pow(iter,0.51);
-			(*Q)[init_state][init_action] = (1-params->alpha) * (*Q)[init_state][init_action]
+			(*Q)(init_state, init_action) = (1-params->alpha) * (*Q)(init_state, init_action)
 											+ params->alpha * (r + params->gamma*(*V)[next_state]);
-			if((*Q)[init_state][init_action] > (*V)[init_state]){
-				(*V)[init_state] = (*Q)[init_state][init_action];
+			if((*Q)(init_state, init_action) > (*V)[init_state]){
+				improved++;
+				max_change = max(max_change, (double)((*Q)(init_state, init_action) - (*V)[init_state]));
+				(*V)[init_state] = (*Q)(init_state, init_action);
 				(*pi)[init_state] = init_action;
+				PROF_COUNT(PROF_IMPROVED, 1);
+			}
+			pthread_mutex_unlock(&writelock);
+			PROF_STOP(t, PROF_UPDATE_TICKS);
+		}
+		
+		// reseed the oracle of this copy with random stream `stream`
+		void seed(long long stream){
+			seedOracle(s, params, stream);
+		}
+		
+		// prioritized sweeping: update every action of the states the schedule hands to
+		// thread_id, at least n updates, and requeue each state by how much V moved
+		void sweepStates(int thread_id, long long n){
+			for(long long k = 0; k < n; k += params->len_action){
+				sweep_state = sweep->pop(thread_id);
+				double before = table ? table->getV(sweep_state) : (*V)[sweep_state];
+				for(int a = 0; a < params->len_action; a++)
+					update(a);
+				sweep->done(sweep_state, (table ? table->getV(sweep_state) : (*V)[sweep_state]) - before);
 			}
-			pthread_mutex_unlock(&writelock);			
 		}
 		
 		// evaluate current policy
 		void test(){
-			test_sailing(s, pi, params);
+			if(table)
+				table->unpack(V, pi);
+			s.test(pi, params);
+		}
+		
+		// copy current policy while other threads keep updating it
+		void snapshot(std::vector<action_t>* pi_copy){
+			if(table){
+				table->unpack(NULL, pi_copy);
+				return;
+			}
+			lockWrite(params);
+			*pi_copy = *pi;
+			pthread_mutex_unlock(&writelock);
+		}
+		
+		// evaluate a policy snapshot
+		void test(std::vector<action_t>* pi_copy){
+			s.test(pi_copy, params);
+		}
+		
+		// checkpoint: Q (len_action entries per state), V, pi
+		void save(Checkpoint* ck){
+			ck->vectors.resize(2);
+			ck->vectors[0].resize((size_t)params->len_state * params->len_action);
+			ck->vectors[1].resize(V->size());
+			ck->pi.resize(pi->size());
+			if(!table)
+				lockWrite(params);
+			for(state_t i = 0; i < params->len_state; i++)
+				for(int a = 0; a < params->len_action; a++)
+					ck->vectors[0][(size_t)i * params->len_action + a] = table ? Q->load(i, a) : (*Q)(i, a);
+			if(table)
+				table->unpack(&ck->vectors[1], &ck->pi);
+			else{
+				ck->vectors[1] = *V;
+				ck->pi = *pi;
+				pthread_mutex_unlock(&writelock);
+			}
+		}
+		
+		void load(const Checkpoint& ck){
+			for(state_t i = 0; i < params->len_state; i++)
+				copy(ck.vectors[0].begin() + (size_t)i * params->len_action,
+				     ck.vectors[0].begin() + (size_t)(i + 1) * params->len_action, Q->row(i));
+			*V = ck.vectors[1];
+			*pi = ck.pi;
+			if(table)
+				table->load(*V, *pi);
 		}
 };
 
+template <class Oracle = Sailing>
 class VRVI{
 	private:
-		int init_state = 0;
+		state_t init_state = 0;
 		int init_action = 0;
-		int next_state = 0;
+		state_t next_state = 0;
 		double r = 0.;
 		double temp = 0.;
-		Sailing s;
+		Oracle s;
+		SimdKernels simd;             // vectorized sweep kernels (defined in simd.h)
+		std::vector<state_t> next_buf;   // next states of the samples of one (state, action)
+		std::vector<double> r_buf;       // rewards of the samples of one (state, action)
+		
+		// n samples of (i, a) into next_buf and r_buf: the draws kept by cache first, if given,
+		// then fresh ones, which the cache keeps as far as it has room
+		void sample(state_t i, int a, int n){
+			if((int)next_buf.size() < n){
+				next_buf.resize(n);
+				r_buf.resize(n);
+			}
+			int m = cache ? cache->get(i, a, n, next_buf.data(), r_buf.data()) : 0;
+			reused += m;
+			if(m == n)
+				return;
+			s.SO(i, a, n - m, next_buf.data() + m, r_buf.data() + m);
+			if(cache)
+				cache->put(i, a, n - m, next_buf.data() + m, r_buf.data() + m);
+		}
 	
 	public:
-		std::vector<std::vector<double>>* x;
-		std::vector<double>* v_outer;
-		std::vector<double>* v_inner;
-		std::vector<int>* pi;
+		QTable* x;
+		std::vector<value_t>* v_outer;
+		std::vector<value_t>* v_inner;
+		std::vector<value_t>* v_next;  // second buffer of v_inner, the inner iterations alternate between them
+		std::vector<action_t>* pi;
 		Params* params;
+		SampleCache* cache;  // draws reused across phases, NULL to draw every sample fresh
+		long long reused;    // kept draws this copy took from cache, added to it when solve ends
 	
-		VRVI(std::vector<std::vector<double>>* x_, 
-						 std::vector<double>* v_outer_,
-						 std::vector<double>* v_inner_,
-						 std::vector<int>* pi_,
+		VRVI(QTable* x_, 
+						 std::vector<value_t>* v_outer_,
+						 std::vector<value_t>* v_inner_,
+						 std::vector<value_t>* v_next_,
+						 std::vector<action_t>* pi_,
 						 Params* params_){
+				cache = NULL;
+				reused = 0;
 				x = x_;
 				v_outer = v_outer_;
 				v_inner = v_inner_;
+				v_next = v_next_;
 				pi = pi_;
 				params = params_;
 				s.setValues(params);			
+				simd = selectKernels(params->simd);
 		}
 	
-		void solve(){
+		// checkpoint: v_outer, v_inner, pi (x is rebuilt every outer iteration)
+		void save(Checkpoint* ck){
+			ck->vectors.push_back(*v_outer);
+			ck->vectors.push_back(*v_inner);
+			ck->pi = *pi;
+		}
+		
+		void load(const Checkpoint& ck){
+			*v_outer = ck.vectors[0];
+			*v_inner = ck.vectors[1];
+			*pi = ck.pi;
+		}
+		
+		// run the solver on the states [lo, hi) owned by thread_id; with several threads
+		// every thread calls solve on its own copy and phases are separated by barrier
+		void solve(int thread_id = 0){
 			srand (time(NULL));
-			for(int t = 0; t < params->max_outer_iter; t++){
+			state_t lo, hi;
+			stateBlock(thread_id, params, &lo, &hi);
+			for(long long t = params->outer; t < params->max_outer_iter; t++){
+				// one random stream per thread and outer iteration, so a resumed run continues the same streams
+				seedOracle(s, params, thread_id + t * params->total_num_threads);
 				
 				// approximate x
-				for(int i = 0; i < params->len_state; i++){
+				for(state_t i = lo; i < hi; i++){
 					for(int a = 0; a < params->len_action; a++){
-						(*x)[i][a] = 0;
-						for(int n = 0; n < params->sample_num_1; n++){
-							s.SO(i, a, next_state, r);
-							(*x)[i][a] += (*v_outer)[next_state];
-						}
-						(*x)[i][a] /= params->sample_num_1;
+						sample(i, a, params->sample_num_1);
+						(*x)(i, a) = simd.gatherSum(v_outer->data(), next_buf.data(), params->sample_num_1)
+						             / params->sample_num_1;
 					}
 				}
+				barrierWait(&barrier);
 				
-				// RandomizedVI
+				// RandomizedVI, in Jacobi form: iteration k reads the values of iteration k-1 from src
+				// and raises its block in dst, which starts as a copy of its block of src, so no
+				// thread reads an entry another one is writing; the buffers swap at the barrier
+				std::vector<value_t>* src = v_inner;
+				std::vector<value_t>* dst = v_next;
 				for(int k = 0; k < params->max_inner_iter; k++){
+					copy(src->begin() + lo, src->begin() + hi, dst->begin() + lo);
 					// APXVAL
-					for(int i = 0; i < params->len_state; i++){
+					for(state_t i = lo; i < hi; i++){
 						for(int a = 0; a < params->len_action; a++){
-							temp = 0.;
-							for(int n = 0; n < params->sample_num_2; n++){
-								s.SO(i, a, next_state, r);
-								temp += r + params->gamma * ((*v_inner)[next_state]-(*v_outer)[next_state]);
-							}
-							temp = temp/params->sample_num_2 + params->gamma * (*x)[i][a]
+							sample(i, a, params->sample_num_2);
+							temp = simd.sum(r_buf.data(), params->sample_num_2) + params->gamma 
+								* simd.gatherDiffSum(src->data(), v_outer->data(), next_buf.data(), params->sample_num_2);
+							temp = temp/params->sample_num_2 + params->gamma * (*x)(i, a)
 								- 2*params->gamma*params->epsilon;
-							if (temp > (*v_inner)[i]){
-								(*v_inner)[i] = temp;
+							if (temp > (*dst)[i]){
+								(*dst)[i] = temp;
 								(*pi)[i] = a;
 							}
 						}
 					}
+					barrierWait(&barrier);
+					swap(src, dst);
 				}
+				if(src != v_inner)
+					copy(src->begin() + lo, src->begin() + hi, v_inner->begin() + lo);
 				
-				// reset parameters. The resetting fashion is tunable
-				params->epsilon /= 2.;
-				params->sample_num_1 *= 4;
-				params->sample_num_2 *= 4;
-				
-				*v_outer = *v_inner;
-				if(t % params->check_step==0){
-					test_sailing(s, pi, params);
+				copy(v_inner->begin() + lo, v_inner->begin() + hi, v_outer->begin() + lo);
+				barrierWait(&barrier);
+				if(thread_id == 0){
+					params->outer = t + 1;
+					// reset parameters. The resetting fashion is tunable
+					params->epsilon /= 2.;
+					params->sample_num_1 *= 4;
+					params->sample_num_2 *= 4;
+					
+					if(t % params->check_step==0){
+						s.test(pi, params);
+						checkpoint(*this, params, 0);
+					}
 				}
-		
+				barrierWait(&barrier);
 			}
+			if(cache)
+				cache->addReused(reused);
 		}
 		
 };
 
+template <class Oracle = Sailing>
 class VRQVI{
 	private:
-		int init_state = 0;
+		state_t init_state = 0;
 		int init_action = 0;
-		int next_state = 0;
+		state_t next_state = 0;
 		double r = 0.;
 		double temp = 0.;
 		double v_outer_max = 0.;
-		Sailing s;
+		Oracle s;
+		SimdKernels simd;             // vectorized sweep kernels (defined in simd.h)
+		std::vector<state_t> next_buf;   // next states of the samples of one (state, action)
+		std::vector<double> r_buf;       // rewards of the samples of one (state, action)
+		
+		// n samples of (i, a) into next_buf and r_buf: the draws kept by cache first, if given,
+		// then fresh ones, which the cache keeps as far as it has room
+		void sample(state_t i, int a, int n){
+			if((int)next_buf.size() < n){
+				next_buf.resize(n);
+				r_buf.resize(n);
+			}
+			int m = cache ? cache->get(i, a, n, next_buf.data(), r_buf.data()) : 0;
+			reused += m;
+			if(m == n)
+				return;
+			s.SO(i, a, n - m, next_buf.data() + m, r_buf.data() + m);
+			if(cache)
+				cache->put(i, a, n - m, next_buf.data() + m, r_buf.data() + m);
+		}
 	
 	public:
-		std::vector<std::vector<double>>* Q;
-		std::vector<std::vector<double>>* w;
-		std::vector<double>* v_outer;
-		std::vector<double>* v_inner;
-		std::vector<int>* pi;
+		QTable* Q;
+		QTable* w;
+		std::vector<value_t>* v_outer;
+		std::vector<value_t>* v_inner;
+		std::vector<action_t>* pi;
 		Params* params;
+		SampleCache* cache;  // draws reused across phases, NULL to draw every sample fresh
+		long long reused;    // kept draws this copy took from cache, added to it when solve ends
 	
-		VRQVI(std::vector<std::vector<double>>* Q_, 
-			 std::vector<std::vector<double>>* w_, 
-						 std::vector<double>* v_outer_,
-						 std::vector<double>* v_inner_,
-						 std::vector<int>* pi_,
+		VRQVI(QTable* Q_, 
+			 QTable* w_, 
+						 std::vector<value_t>* v_outer_,
+						 std::vector<value_t>* v_inner_,
+						 std::vector<action_t>* pi_,
 						 Params* params_){
+				cache = NULL;
+				reused = 0;
 				Q = Q_;
 				w = w_;
 				v_outer = v_outer_;
@@ -257,37 +634,53 @@ class VRQVI{
 				pi = pi_;
 				params = params_;
 				s.setValues(params);			
+				simd = selectKernels(params->simd);
 		}
 	
-		void solve(){
+		// checkpoint: v_outer, v_inner, pi (Q and w are rebuilt every outer iteration)
+		void save(Checkpoint* ck){
+			ck->vectors.push_back(*v_outer);
+			ck->vectors.push_back(*v_inner);
+			ck->pi = *pi;
+		}
+		
+		void load(const Checkpoint& ck){
+			*v_outer = ck.vectors[0];
+			*v_inner = ck.vectors[1];
+			*pi = ck.pi;
+		}
+		
+		// run the solver on the states [lo, hi) owned by thread_id; with several threads
+		// every thread calls solve on its own copy and phases are separated by barrier
+		void solve(int thread_id = 0){
 			srand (time(NULL));
-			for(int t = 0; t < params->max_outer_iter; t++){
+			state_t lo, hi;
+			stateBlock(thread_id, params, &lo, &hi);
+			for(long long t = params->outer; t < params->max_outer_iter; t++){
+				// one random stream per thread and outer iteration, so a resumed run continues the same streams
+				seedOracle(s, params, thread_id + t * params->total_num_threads);
 				
 				// max element of v_fix
 				v_outer_max = fabs((*v_outer)[0]);
-				for(int index = 1; index < params->len_state; index++){
+				for(state_t index = 1; index < params->len_state; index++){
 					if(fabs((*v_outer)[index]) > v_outer_max)
 						v_outer_max = fabs((*v_outer)[index]);
 				}
 				
 				// compute a coarse estimate of Q
-				for(int i = 0; i < params->len_state; i++){
+				for(state_t i = lo; i < hi; i++){
 					for(int a = 0; a < params->len_action; a++){
 						double v_sum = 0;
 						double v_square_sum = 0;
-						double r_sum = 0;
-						for(int n = 0; n < params->sample_num_1; n++){
-							s.SO(i, a, next_state, r);
-							v_sum += (*v_outer)[next_state];
-							v_square_sum += pow((*v_outer)[next_state],2);
-							r_sum += r;
-						}
+						sample(i, a, params->sample_num_1);
+						simd.gatherMoments(v_outer->data(), next_buf.data(), params->sample_num_1, &v_sum, &v_square_sum);
+						double r_sum = simd.sum(r_buf.data(), params->sample_num_1);
 						double v_ave = v_sum / params->sample_num_1;
 						double v_square_ave = v_square_sum / params->sample_num_1;
 						double r_ave = r_sum / params->sample_num_1;
-						(*w)[i][a] = v_ave - sqrt(2*params->alpha1*(v_square_ave-v_ave))
+						(*w)(i, a) = v_ave - sqrt(2*params->alpha1*(v_square_ave-v_ave))
 						            - (4*pow(params->alpha1,0.75) + 2/3*params->alpha1)*v_outer_max;
-						(*Q)[i][a] = r_ave + params->gamma * (*w)[i][a];
+						(*Q)(i, a) = r_ave + params->gamma * (*w)(i, a);
 						
 					}
 				}
@@ -295,36 +688,47 @@ class VRQVI{
 			    // improve Q 
 				for(int k = 0; k < params->max_inner_iter; k++){				
 					// compute the estimate of P(v_inner - v_outer)
-					for(int i = 0; i < params->len_state; i++){
-						// update v and pi
-						if((*v_inner)[i] < *max_element(((*Q)[i]).begin(), ((*Q)[i]).end())){
-							(*v_inner)[i] = *max_element(((*Q)[i]).begin(), ((*Q)[i]).end());
-							(*pi)[i] =  distance(((*Q)[i]).begin(), max_element(((*Q)[i]).begin(), ((*Q)[i]).end()));
+					for(state_t i = lo; i < hi; i++){
+						// update v and pi with a single-pass max and argmax
+						double q_max;
+						int a_max = simd.rowArgmax(Q->row(i), params->len_action, Q->getStride(), &q_max);
+						if((*v_inner)[i] < q_max){
+							(*v_inner)[i] = q_max;
+							(*pi)[i] = a_max;
 						}
 					}
+					barrierWait(&barrier);
 				
-					for(int i = 0; i < params->len_state; i++){
+					for(state_t i = lo; i < hi; i++){
 						for(int a = 0; a < params->len_action; a++){
-							double g = 0.;
-							for(int n = 0; n < params->sample_num_2; n++){
-								s.SO(i, a, next_state, r);
-								g += r + params->gamma * ((*v_inner)[next_state]-(*v_outer)[next_state]);
-							}
-							(*Q)[i][a] = g/params->sample_num_2 -(1-params->gamma)*params->epsilon/8.
-							             + params->gamma * (*w)[i][a];					
+							sample(i, a, params->sample_num_2);
+							double g = simd.sum(r_buf.data(), params->sample_num_2) + params->gamma 
+								* simd.gatherDiffSum(v_inner->data(), v_outer->data(), next_buf.data(), params->sample_num_2);
+							(*Q)(i, a) = g/params->sample_num_2 -(1-params->gamma)*params->epsilon/8.
+							             + params->gamma * (*w)(i, a);					
 						}
 					}
+					barrierWait(&barrier);
 				}
-				// reset parameters. The resetting fashion is tunable
-				params->epsilon /= 2.;
-				params->sample_num_1 *= 2; 
-				params->sample_num_2 *= 2; 
 				
-				*v_outer = *v_inner;
-				if(t % params->check_step==0){
-					test_sailing(s, pi, params);
+				copy(v_inner->begin() + lo, v_inner->begin() + hi, v_outer->begin() + lo);
+				barrierWait(&barrier);
+				if(thread_id == 0){
+					params->outer = t + 1;
+					// reset parameters. The resetting fashion is tunable
+					params->epsilon /= 2.;
+					params->sample_num_1 *= 2; 
+					params->sample_num_2 *= 2; 
+					
+					if(t % params->check_step==0){
+						s.test(pi, params);
+						checkpoint(*this, params, 0);
+					}
 				}
+				barrierWait(&barrier);
 			}
+			if(cache)
+				cache->addReused(reused);
 			return;
 		}
 };
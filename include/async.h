@@ -4,57 +4,172 @@
 #include <iostream>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include "algo.h"
 #include "oracle.h"
+#include "numa.h"
+#include "converge.h"
 using namespace std;
-extern std::atomic<int> iter;
+extern std::atomic<long long> iter;
 extern pthread_barrier_t barrier; 
 
-// asynchronous running with multiple QVI objects 
-void asyncQVI(int thread_id, QVI qvi, Params* params) {
+// claim the next chunk of iterations for thread_id and return its first iteration.
+// In deterministic mode thread t takes chunks t, t+nthreads, ... in turn (counted by
+// round, offset by the chunks before start_iter) and samples chunk c from random
+// stream c, so the samples of an iteration do not depend on the number of threads
+template <class Solver>
+long long claimChunk(int thread_id, long long* round, Solver& solver, Params* params) {
+	if(!params->deterministic)
+		return iter.fetch_add(params->chunk);
+	long long c = (params->start_iter - 1) / params->chunk + thread_id + (*round)++ * params->total_num_threads;
+	solver.seed(c);
+	iter += params->chunk;
+	return 1 + c * params->chunk;
+}
+
+// random stream of worker thread_id, thread_id itself in a fresh run. A run resumed at start_iter
+// takes streams no earlier run of the checkpoint used, so it does not replay their draws
+long long workerStream(int thread_id, Params* params){
+	return ((params->start_iter - 1) << 16) + thread_id;
+}
+
+// asynchronous running with multiple QVI objects, on NUMA shards if shards is not NULL,
+// watched by monitor if not NULL
+template <class Oracle>
+void asyncQVI(int thread_id, QVI<Oracle> qvi, Params* params, NumaShards* shards, ConvergenceMonitor* monitor) {
 	
+	qvi.seed(workerStream(thread_id, params));
+	long long round = 0;
+	if(shards){
+		// pin to the shard's node and place its part of the table there before anyone updates
+		shards->place(thread_id, qvi.table);
+		barrierWait(&barrier);
+	}
 	while(!params->stop){
-		qvi.update(iter);
-		iter++;
+		// claim a contiguous chunk of the global cyclic sweep, one atomic add per chunk
+		long long start = claimChunk(thread_id, &round, qvi, params);
+		long long pos = start;
+		if(shards){
+			// sweep a chunk of a shard instead, its own one most of the time
+			int shard = shards->pick(thread_id, round++);
+			qvi.setShard(shards->lo(shard), shards->hi(shard));
+			pos = shards->claim(shard, params->chunk);
+		}
+		if(qvi.sweep)
+			qvi.sweepStates(thread_id, params->chunk);
+		else if(params->statewise){
+			// whole states: the one of each iteration that starts a state in the cyclic order
+			long long first = (pos + params->len_action - 1) / params->len_action * params->len_action;
+			for(long long k = first; k < pos + params->chunk; k += params->len_action)
+				qvi.updateState(k);
+		}
+		else
+			for(long long k = pos; k < pos + params->chunk; k++)
+				qvi.update(k);
+		// read the store file ahead of the cyclic sweep
+		if(qvi.table && !shards)
+			qvi.table->sweepAt((pos / params->len_action) % params->len_state);
+		if(monitor)
+			monitor->chunk(thread_id, start, params->chunk, &qvi.improved, &qvi.max_change);
 		
-		// evaluate policy every check_step iterations  
-		if(iter > params->threshold){
+		// policy is evaluated by the dedicated evaluator thread, keep sampling
+		if(params->eval_thread){
+			if(start > params->max_outer_iter || params->converged)
+				break;
+			continue;
+		}
+		
+		// evaluate policy every check_step iterations, and a last time once converged
+		if(iter > params->threshold || params->converged){
 			// let one thread check policy quality
-			pthread_barrier_wait(&barrier);
+			barrierWait(&barrier);
 			if(thread_id == 0){
 				cout<<iter<<' ';
 				qvi.test();
 				params->threshold += params->check_step;
-				if(iter > params->max_outer_iter)
+				checkpoint(qvi, params, iter);
+				if(iter > params->max_outer_iter || params->converged)
 					params->stop = 1;
 			}
-			pthread_barrier_wait(&barrier);
+			barrierWait(&barrier);
 		}			
 	}
 	return;
 }
 
-// asynchronous running with multiole Qlearning objects
-void asyncQL(int thread_id, Qlearning ql, Params* params) {
+// asynchronous running with multiole Qlearning objects, watched by monitor if not NULL
+template <class Oracle>
+void asyncQL(int thread_id, Qlearning<Oracle> ql, Params* params, ConvergenceMonitor* monitor) {
 	
+	ql.seed(workerStream(thread_id, params));
+	long long round = 0;
 	while(!params->stop){
-		ql.update(iter);
-		iter++;
+		// claim a contiguous chunk of the global cyclic sweep, one atomic add per chunk
+		long long start = claimChunk(thread_id, &round, ql, params);
+		if(ql.sweep)
+			ql.sweepStates(thread_id, params->chunk);
+		else
+			for(long long k = start; k < start + params->chunk; k++)
+				ql.update(k);
+		if(monitor)
+			monitor->chunk(thread_id, start, params->chunk, &ql.improved, &ql.max_change);
+		
+		// policy is evaluated by the dedicated evaluator thread, keep sampling
+		if(params->eval_thread){
+			if(start > params->max_outer_iter || params->converged)
+				break;
+			continue;
+		}
 		
-		// evaluate policy every check_step iterations
-		if(iter > params->threshold){
+		// evaluate policy every check_step iterations, and a last time once converged
+		if(iter > params->threshold || params->converged){
 			// let one thread check policy quality
-			pthread_barrier_wait(&barrier);
+			barrierWait(&barrier);
 			if(thread_id == 0){
 				cout<<iter<<' ';
 				ql.test();
 				params->threshold += params->check_step;
-				if(iter > params->max_outer_iter)
+				checkpoint(ql, params, iter);
+				if(iter > params->max_outer_iter || params->converged)
 					params->stop = 1;
 			}
-			pthread_barrier_wait(&barrier);
+			barrierWait(&barrier);
 		}	
 	}
 	return;
 }
+
+// dedicated evaluator thread: snapshot pi every check_step iterations and score 
+// the snapshot while the workers keep sampling (no barrier)
+template <class Solver>
+void asyncEval(Solver solver, Params* params) {
+	
+	std::vector<action_t> pi_snapshot(params->len_state, 0);
+	while(!params->stop){
+		long long snapshot_iter = iter;
+		if(snapshot_iter <= params->threshold && snapshot_iter <= params->max_outer_iter && !params->converged){
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		solver.snapshot(&pi_snapshot);
+		
+		// log against the iteration count at snapshot time
+		cout<<snapshot_iter<<' ';
+		solver.test(&pi_snapshot);
+		while(params->threshold < snapshot_iter)
+			params->threshold += params->check_step;
+		checkpoint(solver, params, snapshot_iter);
+		if(snapshot_iter > params->max_outer_iter || params->converged)
+			params->stop = 1;
+	}
+	return;
+}
+
+// synchronous parallel VRVI and VRQVI: each thread runs its own copy of the solver on
+// its block of states, solve separates the phases with barrier
+template <class Solver>
+void syncSolve(int thread_id, Solver solver) {
+	solver.solve(thread_id);
+	return;
+}
 #endif
\ No newline at end of file
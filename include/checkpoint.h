@@ -0,0 +1,223 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include "util.h"
+using namespace std;
+
+// Binary checkpoint of a solver, in native byte order:
+//   CheckpointHeader
+//   per vector: int64 length, value_t values[length]
+//   int64 length, action_t pi[length]
+// The vectors are the solver's value tables in the order its save() pushes them, none and an empty
+// pi for an AsyncQVI run on a store file (-store), which holds V and pi itself. value_t and action_t
+// are the build's element types (util.h), a checkpoint resumes only in a build with the same ones.
+#define CHECKPOINT_MAGIC "AQVICKP5"
+
+struct CheckpointHeader{
+	char magic[8];            // CHECKPOINT_MAGIC
+	int algo;
+	int len_action;
+	int sample_num_1;         // VRVI/VRQVI sample counts after the last outer iteration
+	int sample_num_2;
+	int num_vectors;
+	int value_bytes;          // sizeof(value_t) and sizeof(action_t) of the writing build
+	int action_bytes;
+	int stored;               // 1 if V and pi are in a store file instead of the checkpoint
+	int layout;               // -layout of the run, the state order of the tables
+	int reserved;             // 0
+	long long len_state;
+	long long iter;           // global iteration counter (AsyncQVI, AsyncQL)
+	long long outer;          // next outer iteration (VRVI, VRQVI)
+	long long threshold;      // next policy check
+	double epsilon;           // VRVI/VRQVI epsilon after the last outer iteration
+	double elapsed;           // solver time excluding evaluation
+};
+
+// solver state captured at a policy check
+struct Checkpoint{
+	CheckpointHeader header;
+	std::vector<std::vector<value_t> > vectors;
+	std::vector<action_t> pi;
+
+	// schedule and counters of params, the solver adds its tables with save()
+	Checkpoint(Params* params, long long iter){
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+		header.algo = params->algo;
+		header.len_state = params->len_state;
+		header.len_action = params->len_action;
+		header.value_bytes = sizeof(value_t);
+		header.action_bytes = sizeof(action_t);
+		header.stored = storedRun(params);
+		header.layout = params->layout;
+		header.sample_num_1 = params->sample_num_1;
+		header.sample_num_2 = params->sample_num_2;
+		header.iter = iter;
+		header.outer = params->outer;
+		header.threshold = params->threshold;
+		header.epsilon = params->epsilon;
+		header.elapsed = get_wall_time() - params->test_time - params->time;
+	}
+
+	Checkpoint(){
+		memset(&header, 0, sizeof(header));
+	}
+
+	// write to path.tmp and rename it over path, so path always holds a complete checkpoint
+	bool write(const std::string& path){
+		std::string tmp = path + ".tmp";
+		std::ofstream out(tmp.c_str(), std::ios::binary);
+		header.num_vectors = (int)vectors.size();
+		out.write((const char*)&header, sizeof(header));
+		for(size_t k = 0; k < vectors.size(); k++){
+			long long n = (long long)vectors[k].size();
+			out.write((const char*)&n, sizeof(n));
+			out.write((const char*)vectors[k].data(), n * sizeof(value_t));
+		}
+		long long n = (long long)pi.size();
+		out.write((const char*)&n, sizeof(n));
+		out.write((const char*)pi.data(), n * sizeof(action_t));
+		out.close();
+		if(!out || rename(tmp.c_str(), path.c_str()) != 0){
+			cout << "Cannot write checkpoint " << path << endl;
+			return false;
+		}
+		return true;
+	}
+
+	// read path, false with a message if it is missing or not a checkpoint of params' problem and
+	// algorithm in this build's types, or if its tables do not have the sizes the solver expects
+	bool read(const std::string& path, Params* params){
+		std::ifstream in(path.c_str(), std::ios::binary);
+		in.read((char*)&header, sizeof(header));
+		if(!in || strncmp(header.magic, CHECKPOINT_MAGIC, 8) != 0 || header.algo != params->algo
+		   || header.len_state != params->len_state || header.len_action != params->len_action
+		   || header.value_bytes != (int)sizeof(value_t) || header.action_bytes != (int)sizeof(action_t)){
+			cout << "Checkpoint " << path << " is missing or not of this problem, algorithm and build" << endl;
+			return false;
+		}
+		if(header.stored != storedRun(params)){
+			cout << "Checkpoint " << path << (header.stored ? " keeps V and pi in a store file, resume with -store"
+			                                                : " holds V and pi, resume without -store") << endl;
+			return false;
+		}
+		if(header.layout != params->layout){
+			cout << "Checkpoint " << path << " holds states in -layout " << header.layout << ", resume with it" << endl;
+			return false;
+		}
+		std::vector<long long> lengths = expectedLengths(params);
+		if(header.num_vectors != (int)lengths.size()){
+			cout << "Checkpoint " << path << " has " << header.num_vectors << " tables, expected " << lengths.size() << endl;
+			return false;
+		}
+		vectors.resize(header.num_vectors);
+		for(int k = 0; k < header.num_vectors; k++){
+			long long n = 0;
+			in.read((char*)&n, sizeof(n));
+			if(!in || n != lengths[k]){
+				cout << "Checkpoint " << path << ": table " << k << " has " << n << " entries, expected " << lengths[k] << endl;
+				return false;
+			}
+			vectors[k].resize(n);
+			in.read((char*)vectors[k].data(), n * sizeof(value_t));
+		}
+		long long n = 0;
+		in.read((char*)&n, sizeof(n));
+		if(!in || n != (header.stored ? 0 : params->len_state)){
+			cout << "Checkpoint " << path << ": pi has " << n << " entries, expected " << (header.stored ? 0 : params->len_state) << endl;
+			return false;
+		}
+		pi.resize(n);
+		in.read((char*)pi.data(), n * sizeof(action_t));
+		if(!in)
+			cout << "Checkpoint " << path << " is truncated" << endl;
+		return (bool)in;
+	}
+
+	// 1 if params runs AsyncQVI on a store file (-store), whose checkpoints hold no tables
+	static int storedRun(Params* params){
+		return params->algo == 0 && !params->store.empty();
+	}
+
+	// lengths of the tables the solver of params saves, see their save()
+	static std::vector<long long> expectedLengths(Params* params){
+		long long S = params->len_state, A = params->len_action;
+		std::vector<long long> lengths;
+		if(params->algo == 0){
+			if(!storedRun(params))
+				lengths.push_back(S);              // V
+		}
+		else if(params->algo == 1){
+			lengths.push_back(S * A);              // Q
+			lengths.push_back(S);                  // V
+		}
+		else{
+			lengths.push_back(S);                  // v_outer
+			lengths.push_back(S);                  // v_inner
+		}
+		return lengths;
+	}
+};
+
+// background writer: at most one checkpoint is being written, a policy check that finds it busy
+// skips its checkpoint instead of waiting, so a slow disk does not hold the workers at the barrier
+std::thread checkpoint_writer;
+std::atomic<bool> checkpoint_busy(false);   // the writer has not finished its checkpoint yet
+
+void writeCheckpointAsync(std::shared_ptr<Checkpoint> ck, const std::string& path){
+	if(checkpoint_writer.joinable())
+		checkpoint_writer.join();   // finished, returns at once
+	checkpoint_busy = true;
+	checkpoint_writer = std::thread([ck, path](){
+		ck->write(path);
+		checkpoint_busy = false;
+	});
+}
+
+// wait for the last checkpoint to reach the disk
+void finishCheckpoint(){
+	if(checkpoint_writer.joinable())
+		checkpoint_writer.join();
+}
+
+// snapshot the solver at iteration iter and write it in the background if params->checkpoint is set,
+// unless the last checkpoint is still being written: then the file keeps that one
+template <class Solver>
+void checkpoint(Solver& solver, Params* params, long long iter){
+	if(params->checkpoint.empty() || checkpoint_busy)
+		return;
+	std::shared_ptr<Checkpoint> ck = std::make_shared<Checkpoint>(params, iter);
+	solver.save(ck.get());
+	writeCheckpointAsync(ck, params->checkpoint);
+}
+
+// restore the solver, params' schedule and the iteration counter from params->checkpoint
+template <class Solver>
+void resume(Solver& solver, Params* params, std::atomic<long long>* iter){
+	Checkpoint ck;
+	if(!ck.read(params->checkpoint, params)){
+		cout << "Cannot resume from checkpoint " << params->checkpoint << endl;
+		exit(1);
+	}
+	solver.load(ck);
+	*iter = ck.header.iter;
+	params->start_iter = ck.header.iter;
+	params->outer = ck.header.outer;
+	params->threshold = ck.header.threshold;
+	params->epsilon = ck.header.epsilon;
+	params->sample_num_1 = ck.header.sample_num_1;
+	params->sample_num_2 = ck.header.sample_num_2;
+	// reported times continue from the checkpoint
+	params->time = get_wall_time() - params->test_time - ck.header.elapsed;
+}
+
+#endif
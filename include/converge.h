@@ -0,0 +1,106 @@
+#ifndef CONVERGE_H
+#define CONVERGE_H
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "util.h"
+using namespace std;
+
+// Convergence monitor of AsyncQVI and AsyncQL (-converge_tol). Each thread counts, in its
+// solver copy, the V entries it raised and the largest raise, and adds them to its own slot
+// once per chunk. A sweep is len_state*len_action iterations; the thread whose chunk starts
+// the next sweep sums the slots for the finished one. After converge_sweeps sweeps in a row
+// whose largest raise is at most converge_tol, params->converged is set and the drivers stop
+// as if max_outer_iter was reached.
+
+// counters of one thread for its current and previous sweep, on its own cache line
+struct alignas(64) ConvergenceSlot{
+	std::mutex lock;
+	long long sweep;         // sweep of the current counters, -1 before the first chunk
+	long long improved;
+	double max_change;
+	long long prev_sweep;    // sweep of the previous counters
+	long long prev_improved;
+	double prev_max_change;
+};
+
+class ConvergenceMonitor{
+
+	private:
+		Params* params;
+		long long len;               // iterations per sweep
+		int nthreads;
+		AlignedArray<ConvergenceSlot> slots;   // one cache line each (defined in util.h)
+		std::mutex aggregate;
+		int quiet;                   // finished sweeps in a row within the tolerance
+
+		static long long sweepOf(long long k, long long len){
+			return (k - 1) / len;    // iterations count from 1
+		}
+
+		// sum the slots for sweep q and update the stopping rule
+		void finish(long long q){
+			long long improved = 0;
+			double max_change = 0.;
+			for(int t = 0; t < nthreads; t++){
+				ConvergenceSlot& s = slots[t];
+				std::lock_guard<std::mutex> guard(s.lock);
+				// a thread still behind q counts with its last counters, which can only delay stopping
+				if(s.sweep <= q){
+					improved += s.improved;
+					max_change = max(max_change, s.max_change);
+				}
+				else if(s.prev_sweep == q){
+					improved += s.prev_improved;
+					max_change = max(max_change, s.prev_max_change);
+				}
+			}
+			std::lock_guard<std::mutex> guard(aggregate);
+			quiet = max_change <= params->converge_tol ? quiet + 1 : 0;
+			if(quiet >= params->converge_sweeps && !params->converged){
+				cout<<"converged "<<(q + 1) * len<<" sweep "<<q<<" max_change "<<max_change<<" improved "<<improved<<endl;
+				params->converged = 1;
+			}
+		}
+
+	public:
+
+		ConvergenceMonitor(Params* params_) : params(params_), nthreads(params_->total_num_threads),
+		                                      slots(alignedArray<ConvergenceSlot>(params_->total_num_threads)), quiet(0){
+			len = max(1LL, (long long)params->len_state * params->len_action);
+			for(int t = 0; t < nthreads; t++){
+				slots[t].sweep = slots[t].prev_sweep = -1;
+				slots[t].improved = slots[t].prev_improved = 0;
+				slots[t].max_change = slots[t].prev_max_change = 0.;
+			}
+		}
+
+		// thread_id finished iterations [start, start+n) with counters *improved and *max_change:
+		// add them to its slot and reset them, and sum up the sweep this chunk ended
+		void chunk(int thread_id, long long start, long long n, long long* improved, double* max_change){
+			long long sweep = sweepOf(start, len);
+			ConvergenceSlot& s = slots[thread_id];
+			{
+				std::lock_guard<std::mutex> guard(s.lock);
+				if(sweep != s.sweep){
+					s.prev_sweep = s.sweep;
+					s.prev_improved = s.improved;
+					s.prev_max_change = s.max_change;
+					s.sweep = sweep;
+					s.improved = 0;
+					s.max_change = 0.;
+				}
+				s.improved += *improved;
+				s.max_change = max(s.max_change, *max_change);
+			}
+			*improved = 0;
+			*max_change = 0.;
+			long long last = sweepOf(start + n - 1, len);
+			if(last > 0 && last * len + 1 >= start)
+				finish(last - 1);
+		}
+};
+
+#endif
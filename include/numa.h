@@ -0,0 +1,143 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <pthread.h>
+#include "util.h"
+#include "packed.h"
+using namespace std;
+
+// NUMA-aware AsyncQVI (-numa): the states are split into one shard per node, every
+// thread is pinned to a CPU of its shard's node and first touches its shard of the
+// lock-free table, and sweeps its own shard for a share numa_local of its chunks.
+// V is still read globally. Topology is read from Linux sysfs, elsewhere there is
+// one node and pinning does nothing.
+
+// CPUs of "0-3,8-11"
+std::vector<int> parseCpuList(const std::string& text){
+	std::vector<int> cpus;
+	std::stringstream ss(text);
+	std::string item;
+	while(std::getline(ss, item, ',')){
+		if(item.empty() || item[0] == '\n')
+			continue;
+		size_t dash = item.find('-');
+		int lo = atoi(item.c_str());
+		int hi = dash == std::string::npos ? lo : atoi(item.c_str() + dash + 1);
+		for(int c = lo; c <= hi; c++)
+			cpus.push_back(c);
+	}
+	return cpus;
+}
+
+// CPUs of every NUMA node, one node with all hardware threads if the topology is unknown
+std::vector<std::vector<int> > numaNodes(){
+	std::vector<std::vector<int> > nodes;
+	for(int n = 0; ; n++){
+		std::ifstream in(("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist").c_str());
+		std::string text;
+		if(!std::getline(in, text))
+			break;
+		std::vector<int> cpus = parseCpuList(text);
+		if(!cpus.empty())
+			nodes.push_back(cpus);
+	}
+	if(nodes.empty()){
+		int n = std::max(1u, std::thread::hardware_concurrency());
+		nodes.push_back(std::vector<int>());
+		for(int c = 0; c < n; c++)
+			nodes[0].push_back(c);
+	}
+	return nodes;
+}
+
+// pin the calling thread to cpu, false if unsupported or refused
+bool pinThread(int cpu){
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+// sweep position of one shard, on its own cache line
+struct alignas(64) ShardCounter{
+	std::atomic<long long> next;
+};
+
+class NumaShards{
+
+	private:
+		std::vector<std::vector<int> > nodes;
+		std::vector<state_t> bounds;             // shard s is states [bounds[s], bounds[s+1])
+		AlignedArray<ShardCounter> counters;     // one cache line each (defined in util.h)
+		int every;                               // every every-th chunk of a thread is foreign
+
+	public:
+		int num;
+
+		// params->numa shards (one per node if 1), at most one per thread, boundaries on page multiples of the table
+		NumaShards(Params* params){
+			nodes = numaNodes();
+			num = params->numa == 1 ? (int)nodes.size() : params->numa;
+			num = std::max(1, std::min(num, params->total_num_threads));
+			int align = params->len_state >= num * 4096 / (int)sizeof(uint64_t) ? 4096 / (int)sizeof(uint64_t) : 1;
+			bounds.resize(num + 1);
+			for(int s = 0; s <= num; s++)
+				bounds[s] = (state_t)((long long)params->len_state * s / num / align * align);
+			bounds[num] = params->len_state;
+			counters = alignedArray<ShardCounter>(num);
+			for(int s = 0; s < num; s++)
+				counters[s].next = 0;
+			every = params->numa_local < 1. ? std::max(1, (int)(1. / (1. - params->numa_local) + 0.5)) : 0;
+		}
+
+		int shardOf(int thread_id) const{
+			return thread_id % num;
+		}
+
+		state_t lo(int shard) const{
+			return bounds[shard];
+		}
+
+		state_t hi(int shard) const{
+			return bounds[shard + 1];
+		}
+
+		// pin thread_id to a CPU of its shard's node (shards wrap around the nodes), then the
+		// first thread of each shard writes the shard's slots of table so they are placed there
+		void place(int thread_id, PackedTable* table){
+			int shard = shardOf(thread_id);
+			const std::vector<int>& cpus = nodes[shard % nodes.size()];
+			pinThread(cpus[(thread_id / num) % cpus.size()]);
+			if(table && thread_id < num)
+				table->touch(lo(shard), hi(shard));
+		}
+
+		// shard of the round-th chunk of thread_id: its own, but every every-th chunk goes
+		// to the other shards in turn, so all shards keep being swept by every node
+		int pick(int thread_id, long long round) const{
+			int own = shardOf(thread_id);
+			if(num == 1 || every == 0 || (round + 1) % every != 0)
+				return own;
+			long long k = (round + 1) / every;
+			return (int)((own + 1 + k % (num - 1)) % num);
+		}
+
+		// claim chunk iterations of the cyclic sweep of shard, return the first
+		long long claim(int shard, int chunk){
+			return counters[shard].next.fetch_add(chunk, std::memory_order_relaxed);
+		}
+};
+
+#endif
@@ -6,10 +6,30 @@
 #include <string>
 #include <math.h>
 #include <random>
+#include <thread>
+#include <functional>
+#include <vector>
 #include "util.h"
+#include "rng.h"
+#include "profile.h"
+#include "pool.h"
 #define DIMWIND 8
 using namespace std; 
 
+template <class Oracle>
+double test_policy(Oracle& s, std::vector<action_t>* pi, Params* params);
+
+#define EVAL_STREAM (1ULL << 62)   // random stream of the first evaluation oracle
+
+// reseed oracle s with stream `stream` of params->seed, or from std::random_device if no seed is set
+template <class Oracle>
+void seedOracle(Oracle& s, Params* params, uint64_t stream){
+	if(params->seed >= 0)
+		s.seed(params->seed, stream);
+	else
+		s.setValues(params);
+}
+
 // sample orable for sailing problem
 class Sailing{
     
@@ -22,11 +42,29 @@ class Sailing{
 		int GOALX;				// x coordinate of Goal state
 		int GOALY;				// y coordinate of Goal state
 		double probs; 			// probability of being trapped in vortex
-		double d;               // reward scale parameter
-		
-		// local random generator, faster for parallel computing
+		double d;               // reward scale parameter
+		state_t len_state;      // number of states
+		int len_action;         // number of actions
+		int tile;               // state layout: 0 wind-major, else tile x tile grid tiles with wind innermost
+		
+		// local random generator, faster for parallel computing
 		std::mt19937 local_rng; 
-		
+		
+		// distributions of the transition noise, built once and reused by every sample
+		std::normal_distribution<double> drift{0., 0.1};   // positioning noise
+		std::normal_distribution<double> swirl{0., 1.};    // vortex displacement
+		std::uniform_real_distribution<double> unit{0., 1.};
+		
+		// cumulative wind_transition rows, wind_cdf[w][n] = sum of wind_transition[w][0..n]
+		double wind_cdf[DIMWIND][DIMWIND];
+		
+		// fast sampling path (params->fast_rng): xoshiro256** and alias tables (defined in rng.h)
+		int fast = 0;
+		Xoshiro256 fast_rng;
+		AliasTable drift_table;               // (int) of the positioning noise
+		AliasTable swirl_table;               // (int) of the vortex displacement
+		AliasTable wind_table[DIMWIND];       // next wind given the current one
+		
 		// transition matrix for wind direction
 		float wind_transition[DIMWIND][DIMWIND] = {
 			{0.3, 0.2, 0.1, 0.04, 0.02, 0.04, 0.1, 0.2},
@@ -39,17 +77,60 @@ class Sailing{
 			{0.2, 0.1, 0.04, 0.02, 0.04, 0.1, 0.2, 0.3}
 		};
 	
-	public:
-		
+	public:
+		
 		void setValues(Params* params){
 			DIMX = (int)sqrt(params->len_state/DIMWIND);
 			DIMY = DIMX;
 			GOALX = (int)DIMX/2; // the target place is the center of the grid
 			GOALY = GOALX;
-			probs = params->probs;
+			probs = params->probs;
 			d = params->d;
+			len_state = params->len_state;
+			len_action = params->len_action;
+			tile = params->layout;
 			std::random_device rd; 
 			local_rng.seed(rd());
+			for(int w = 0; w < DIMWIND; w++){
+				double start = 0;
+				for(int nwind = 0; nwind < DIMWIND; nwind++){
+					start += wind_transition[w][nwind];
+					wind_cdf[w][nwind] = start;
+				}
+			}
+			fast = params->fast_rng;
+			fast_rng.seed(((uint64_t)rd() << 32) | rd());
+			drift_table.buildTruncatedNormal(0.1);
+			swirl_table.buildTruncatedNormal(1.);
+			for(int w = 0; w < DIMWIND; w++){
+				double row[DIMWIND];
+				for(int nwind = 0; nwind < DIMWIND; nwind++)
+					row[nwind] = wind_transition[w][nwind];
+				wind_table[w].build(row, DIMWIND, 0);
+			}
+		}
+		
+		// reproducible stream: stream k of seed, streams of one seed are independent
+		void seed(uint64_t seed, uint64_t stream){
+			std::seed_seq seq{(uint32_t)seed, (uint32_t)(seed >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+			local_rng.seed(seq);
+			fast_rng.seed(seed, stream);
+			drift.reset();
+			swirl.reset();
+			unit.reset();
+		}
+		
+		state_t numStates() const{
+			return len_state;
+		}
+		
+		int numActions() const{
+			return len_action;
+		}
+		
+		// policy evaluation by episodes on copies of this oracle
+		double test(std::vector<action_t>* pi, Params* params){
+			return test_policy(*this, pi, params);
 		}
 		
 		double localNormalDouble(double mean, double sd){ 
@@ -62,17 +143,59 @@ class Sailing{
 			return unif(local_rng);
 		}
 		
+		state_t localUniformInt(state_t start, state_t end){
+			std::uniform_int_distribution<state_t> uni(start, end);
+			return uni(local_rng);
+		}
+		
 		
 		// map the ith state to position and wind
-		void indexToState(int index){
-			wind = index / (DIMX * DIMY);
-			x = (index - DIMX * DIMY * wind) / DIMY;
-			y = index - DIMX * DIMY * wind - DIMY * x;
+		void indexToState(state_t index){
+			if(tile){
+				tiledToState(index);
+				return;
+			}
+			state_t plane = (state_t)DIMX * DIMY;
+			wind = (int)(index / plane);
+			x = (int)((index - plane * wind) / DIMY);
+			y = (int)(index - plane * wind - (state_t)DIMY * x);
 		}
 		
 		// map position and wind to the ith state
-		int stateToIndex(){
-			return wind * DIMX * DIMY + x * DIMY + y;
+		state_t stateToIndex(){
+			if(tile)
+				return stateToTiled();
+			return (state_t)wind * DIMX * DIMY + (state_t)x * DIMY + y;
+		}
+		
+		// tiled layout: the grid is cut into bands of tile rows of x, each band into tiles of
+		// tile columns of y (smaller at the edges), cells are row-major inside a tile and the
+		// winds of a cell are adjacent, so the next states of a sample stay close to it
+		void tiledToState(state_t index){
+			state_t cell = index / DIMWIND;
+			wind = (int)(index - cell * DIMWIND);
+			int tx = (int)(cell / ((state_t)tile * DIMY));
+			int rest = (int)(cell - (state_t)tx * tile * DIMY);
+			int h = min(tile, DIMX - tx * tile);
+			int ty = rest / (tile * h);
+			rest -= ty * tile * h;
+			int w = min(tile, DIMY - ty * tile);
+			x = tx * tile + rest / w;
+			y = ty * tile + rest % w;
+		}
+		
+		state_t stateToTiled(){
+			int tx = x / tile, ty = y / tile;
+			int h = min(tile, DIMX - tx * tile);
+			int w = min(tile, DIMY - ty * tile);
+			state_t cell = (state_t)tx * tile * DIMY + ty * tile * h + (x - tx * tile) * w + (y - ty * tile);
+			return cell * DIMWIND + wind;
+		}
+		
+		// index of state i in the wind-major layout, for outputs independent of -layout
+		state_t originalIndex(state_t i){
+			indexToState(i);
+			return (state_t)wind * DIMX * DIMY + (state_t)x * DIMY + y;
 		}
 		
 		// actions
@@ -96,15 +219,25 @@ class Sailing{
 			x = max(0, min(x + dir.first, DIMX-1));
 			y = max(0, min(y + dir.second, DIMY-1));
 			
+			if(fast){
+				x = max(0, min(x + drift_table.sample(fast_rng.next()), DIMX-1));
+				y = max(0, min(y + drift_table.sample(fast_rng.next()), DIMY-1));
+				if(fast_rng.uniform() < probs){
+					x = max(0, min(x + swirl_table.sample(fast_rng.next()), DIMX-1));
+					y = max(0, min(y + swirl_table.sample(fast_rng.next()), DIMY-1));
+				}
+				return;
+			}
+			
 			// some noise in positioning
 			// simulate wind
-			x = max(0, min(x + (int)localNormalDouble(0.,0.1), DIMX-1));
-			y = max(0, min(y + (int)localNormalDouble(0.,0.1), DIMY-1));
+			x = max(0, min(x + (int)drift(local_rng), DIMX-1));
+			y = max(0, min(y + (int)drift(local_rng), DIMY-1));
 
 			// simulate vortex
-			if(localUniformDouble(0,1) < probs){
-				x = max(0, min(x + (int)localNormalDouble(0.,1.), DIMX-1));
-				y = max(0, min(y + (int)localNormalDouble(0.,1.), DIMY-1));
+			if(unit(local_rng) < probs){
+				x = max(0, min(x + (int)swirl(local_rng), DIMX-1));
+				y = max(0, min(y + (int)swirl(local_rng), DIMY-1));
 			}
 		}
 		
@@ -123,60 +256,141 @@ class Sailing{
 		}
 		
 		void windTransition(){
-			double prob = localUniformDouble(0, 1);
-			double start = 0;
+			if(fast){
+				wind = wind_table[wind].sample(fast_rng.next());
+				return;
+			}
+			double prob = unit(local_rng);
 			for(int nwind = 0; nwind < DIMWIND; nwind++){
-				start += wind_transition[wind][nwind];
-				if(start > prob){
+				if(wind_cdf[wind][nwind] > prob){
 					wind = nwind;
 					break;
 				}
 			}
 		}		
 		
-		// sample oracle function: given init_state[i], init_action[a], rewrite next_state[j] and reward[r]
-		void SO(int i, int a, int& j, double& r){
-			indexToState(i);
+		// one transition from the current (x, y, wind) under action a
+		void step(int a, state_t& j, double& r){
 			apply(a);
 			r = reward(a);
 			windTransition();
 			j = stateToIndex();
 		}
 		
+		// sample oracle function: given init_state[i], init_action[a], rewrite next_state[j] and reward[r]
+		void SO(state_t i, int a, state_t& j, double& r){
+			PROF_START(t);
+			indexToState(i);
+			step(a, j, r);
+			PROF_STOP(t, PROF_ORACLE_TICKS);
+			PROF_COUNT(PROF_ORACLE_CALLS, 1);
+		}
+		
+		// m samples of the same (i, a): i is decoded once, next states go to j[0..m) and rewards to r[0..m)
+		void SO(state_t i, int a, int m, state_t* j, double* r){
+			PROF_START(t);
+			indexToState(i);
+			int x0 = x, y0 = y, wind0 = wind;
+			for(int k = 0; k < m; k++){
+				x = x0;
+				y = y0;
+				wind = wind0;
+				step(a, j[k], r[k]);
+			}
+			PROF_STOP(t, PROF_ORACLE_TICKS);
+			PROF_COUNT(PROF_ORACLE_CALLS, m);
+		}
+		
+		// one sample for each of the n pairs (i[k], a[k]) into j[k] and r[k]
+		void SO(const state_t* i, const int* a, int n, state_t* j, double* r){
+			for(int k = 0; k < n; k++)
+				SO(i[k], a[k], j[k], r[k]);
+		}
+		
 };
 
 
-// policy evaluation
-void test_sailing(Sailing& s, std::vector<int>* pi, Params* params){
+// accumulated result of evaluation episodes
+struct EvalResult{
+	double sum = 0.;    // sum of episode discounted rewards
+	double sum_sq = 0.; // sum of squared episode discounted rewards
+	int flag = 0;       // number of episodes that reached the goal state
+};
+
+// run episodes of policy pi on oracle s, each from a uniformly random state;
+// an episode reaches the goal when it collects a reward of 1
+template <class Oracle>
+void rollout_policy(Oracle& s, std::vector<action_t>* pi, Params* params, int episodes, EvalResult* res){
 	
-	double start_time = get_wall_time();
-	s.setValues(params);
-	// total discounted reward
-	double total_reward = 0.;
-	// how many times has the goal state been reached.
-	int flag = 0;
-	int isflag = 0;
-	// run text_max_episode episodes
-	for (int episode = 0; episode < params->test_max_episode; episode++){
+	for (int episode = 0; episode < episodes; episode++){
 		// start from an arbitrary state
-		int i = uniformInt(0,params->len_state-1);
-		int j = 0;
+		state_t i = s.localUniformInt(0,params->len_state-1);
+		state_t j = 0;
 		double r = 0;
-		isflag = 0;
+		double discount = 1.;
+		double episode_reward = 0.;
+		int isflag = 0;
 		for (int step = 0; step < params->test_max_step; step++){
 			s.SO(i,(*pi)[i],j,r);
-			total_reward += pow(params->gamma,step)*r;
+			episode_reward += discount*r;
+			discount *= params->gamma;
 			if(r == 1 && !isflag){
-				flag += 1;
+				res->flag += 1;
 				isflag = 1;
 			}
 			i = j;
 		}
+		res->sum += episode_reward;
+		res->sum_sq += episode_reward*episode_reward;
 	}
-	params->test_time += get_wall_time() - start_time;
-	// average total reward
-	total_reward /= params->test_max_episode;
-	cout<<get_wall_time()-params->test_time-params->time<<' '<<total_reward<<' '<<flag<<endl;
 	return;
 }
+
+// policy evaluation, episodes are split over eval_threads threads with independent oracles
+template <class Oracle>
+double test_policy(Oracle& s, std::vector<action_t>* pi, Params* params){
+	
+	double start_time = get_wall_time();
+	int nthreads = max(1, min(params->eval_threads, params->test_max_episode));
+	std::vector<EvalResult> results(nthreads);
+	// episodes run on copies of s so the sample stream of s is left untouched;
+	// with a seed every evaluation replays the same episodes
+	std::vector<Oracle> oracles(nthreads, s);
+	for (int t = 0; t < nthreads; t++){
+		seedOracle(oracles[t], params, EVAL_STREAM + t);
+	}
+	if(nthreads == 1){
+		rollout_policy(oracles[0], pi, params, params->test_max_episode, &results[0]);
+	}
+	else{
+		// on the persistent evaluation threads (defined in pool.h)
+		evalPool().run(nthreads, [&](int t){
+			int episodes = params->test_max_episode/nthreads + (t < params->test_max_episode%nthreads);
+			rollout_policy<Oracle>(oracles[t], pi, params, episodes, &results[t]);
+		});
+	}
+	EvalResult total;
+	for (int t = 0; t < nthreads; t++){
+		total.sum += results[t].sum;
+		total.sum_sq += results[t].sum_sq;
+		total.flag += results[t].flag;
+	}
+	// evaluation time is excluded from the reported time unless it ran beside the workers
+	params->eval_time += get_wall_time() - start_time;
+	if(!params->eval_thread)
+		params->test_time += get_wall_time() - start_time;
+	
+	// average total reward, half width of its 95% confidence interval and goal-hit rate
+	int n = params->test_max_episode;
+	double total_reward = total.sum / n;
+	double var = n > 1 ? max(0., (total.sum_sq - n*total_reward*total_reward)/(n-1)) : 0.;
+	double ci = 1.96 * sqrt(var/n);
+	double rate = (double)total.flag / n;
+	double elapsed = get_wall_time()-params->test_time-params->time;
+	params->reward = total_reward;
+	if(params->target_time < 0 && total_reward >= params->target)
+		params->target_time = elapsed;
+	cout<<elapsed<<' '<<total_reward<<' '<<total.flag<<' '<<ci<<' '<<rate<<endl;
+	return total_reward;
+}
 #endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <iostream>
+#include "util.h"
+using namespace std;
+
+// lock-free shared table: V[i] and pi[i] packed into one 64-bit word.
+// The high 48 bits hold V[i] as a truncated IEEE double, the low 16 bits hold pi[i],
+// so a single compare-and-swap raises the value and switches the action together.
+// The slot is 64 bits in every build, value_t (util.h) only sets the type V is unpacked to.
+// The slots live in zeroed pages (all-zero is V = 0, pi = 0), so a page is placed
+// on the node of the first thread writing it, see touch().
+//
+// With a store path the slots live in that file instead, mapped shared after a header page,
+// so the kernel pages them in and out and the table can exceed memory. Indices are 64-bit.
+#define ACTION_BITS 16
+#define ACTION_MASK ((1ULL << ACTION_BITS) - 1)
+#define STORE_MAGIC "AQVISTO2"
+#define STORE_HEADER 4096        // bytes before the slots of a store file
+
+struct StoreHeader{
+	char magic[8];               // STORE_MAGIC
+	long long len_state;
+	long long layout;            // -layout of the run, the state order of the slots
+};
+
+class PackedTable{
+
+	private:
+		long long len;
+		std::atomic<uint64_t>* slots;   // trivially constructible words, valid when zeroed
+		char* store;                    // mapping of the store file, NULL for memory pages
+		size_t store_bytes;
+		long long window;               // states read ahead of the cyclic sweep, 0 off
+		std::atomic<long long> ahead;   // last window the sweep entered
+
+		PackedTable(const PackedTable&);
+		PackedTable& operator=(const PackedTable&);
+
+	public:
+
+		PackedTable(long long len_state) : len(len_state), store(NULL), store_bytes(0), window(0), ahead(-1){
+			slots = (std::atomic<uint64_t>*)allocPages((size_t)len * sizeof(uint64_t));
+		}
+
+		// slots in the store file path: kept if keep and the file holds a table of len_state, zeroed
+		// otherwise. The kernel is told how params' sweep reads the table
+		PackedTable(long long len_state, const std::string& path, bool keep, Params* params)
+			: len(len_state), window(0), ahead(-1){
+			store_bytes = STORE_HEADER + (size_t)len * sizeof(uint64_t);
+			store = (char*)mapStore(path.c_str(), store_bytes, keep);
+			if(!store){
+				if(keep)
+					cout << "Cannot open store " << path << ", missing or smaller than " << len << " states" << endl;
+				else
+					cout << "Cannot map store " << path << endl;
+				exit(1);
+			}
+			StoreHeader* h = (StoreHeader*)store;
+			if(keep && !(strncmp(h->magic, STORE_MAGIC, 8) == 0 && h->len_state == len)){
+				cout << "Store " << path << " does not hold " << len << " states" << endl;
+				exit(1);
+			}
+			if(keep && h->layout != params->layout){
+				cout << "Store " << path << " holds states in -layout " << h->layout << ", reopen it with that layout" << endl;
+				exit(1);
+			}
+			memcpy(h->magic, STORE_MAGIC, 8);
+			h->len_state = len;
+			h->layout = params->layout;
+			slots = (std::atomic<uint64_t>*)(store + STORE_HEADER);
+			if(params->store_huge)
+				adviseStore(slots, (size_t)len * sizeof(uint64_t), STORE_HUGE);
+			if(params->style == 1 && !params->numa){
+				adviseStore(slots, (size_t)len * sizeof(uint64_t), STORE_SEQUENTIAL);
+				window = (long long)params->store_ahead * (1 << 20) / sizeof(uint64_t);
+			}
+			else if(params->style == 0)
+				adviseStore(slots, (size_t)len * sizeof(uint64_t), STORE_RANDOM);
+		}
+
+		~PackedTable(){
+			if(store)
+				unmapStore(store, store_bytes);
+			else
+				freePages(slots, (size_t)len * sizeof(uint64_t));
+		}
+
+		static uint64_t pack(double v, int a){
+			uint64_t bits;
+			memcpy(&bits, &v, sizeof(bits));
+			return (bits & ~ACTION_MASK) | ((uint64_t)a & ACTION_MASK);
+		}
+
+		static double value(uint64_t word){
+			double v;
+			word &= ~ACTION_MASK;
+			memcpy(&v, &word, sizeof(v));
+			return v;
+		}
+
+		static int action(uint64_t word){
+			return (int)(word & ACTION_MASK);
+		}
+
+		long long size() const{
+			return len;
+		}
+
+		// true if the slots live in a store file
+		bool mapped() const{
+			return store != NULL;
+		}
+
+		// write the dirty pages of the store back to its file; without wait the writeback is only
+		// scheduled, so a policy check does not hold the workers for it
+		void flush(bool wait = true){
+			if(store)
+				syncStore(store, store_bytes, wait);
+		}
+
+		// the cyclic sweep is at state i: when it enters a new window, have the kernel read the next one
+		void sweepAt(long long i){
+			if(!window)
+				return;
+			long long w = i / window;
+			long long seen = ahead.load(std::memory_order_relaxed);
+			if(w == seen || !ahead.compare_exchange_strong(seen, w, std::memory_order_relaxed))
+				return;
+			long long lo = (w + 1) * window % len;
+			long long n = min(window, len - lo);
+			adviseStore(slots + lo, (size_t)n * sizeof(uint64_t), STORE_WILLNEED);
+		}
+
+		// rewrite slots [lo, hi) with their own values, so their pages land on the calling thread's node;
+		// only before the updates start, a concurrent raise could be lost
+		void touch(long long lo, long long hi){
+			for(long long i = lo; i < hi; i++)
+				slots[i].store(slots[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+
+		double getV(long long i) const{
+			return value(slots[i].load(std::memory_order_relaxed));
+		}
+
+		int getPi(long long i) const{
+			return action(slots[i].load(std::memory_order_relaxed));
+		}
+
+		// atomic max: raise V[i] to v and set pi[i] = a only if v is larger, return true on success
+		// and leave the replaced value in *old_v if given
+		bool raise(long long i, double v, int a, double* old_v = NULL){
+			uint64_t desired = pack(v, a);
+			double newV = value(desired);
+			uint64_t old = slots[i].load(std::memory_order_relaxed);
+			while(newV > value(old)){
+				if(slots[i].compare_exchange_weak(old, desired, std::memory_order_relaxed)){
+					if(old_v)
+						*old_v = value(old);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// copy plain V and pi vectors into the packed slots (for resuming)
+		void load(const std::vector<value_t>& V, const std::vector<action_t>& pi){
+			for(long long i = 0; i < size(); i++)
+				slots[i].store(pack(V[i], pi[i]), std::memory_order_relaxed);
+		}
+
+		// copy the packed slots out to plain V and pi vectors (for testing and saving)
+		void unpack(std::vector<value_t>* V, std::vector<action_t>* pi) const{
+			for(long long i = 0; i < size(); i++){
+				uint64_t word = slots[i].load(std::memory_order_relaxed);
+				if(V) (*V)[i] = value(word);
+				if(pi) (*pi)[i] = (action_t)action(word);
+			}
+		}
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include "util.h"
+#include "qtable.h"
+using namespace std;
+
+// Binary policy file, in native byte order, every section starting at a multiple of 8 bytes:
+//   PolicyHeader
+//   pi[len_state]              pi_bytes per entry: 1, 2 or 4, the smallest that holds len_action-1
+//   V[len_state]               value_bytes per entry: 4 float or 8 double, if has_v
+//   Q[len_state*len_action]    row-major, value_bytes per entry, if has_q
+#define POLICY_MAGIC "AQVIPOL2"
+
+struct PolicyHeader{
+	char magic[8];        // POLICY_MAGIC
+	int64_t len_state;
+	int32_t len_action;
+	int32_t pi_bytes;
+	double gamma;
+	int32_t value_bytes;
+	int32_t has_v;
+	int32_t has_q;
+	int32_t reserved;     // 0, pads the header to a multiple of 8 bytes
+};
+
+// n bytes rounded up to a multiple of 8
+inline size_t policyPad(size_t n){
+	return (n + 7) / 8 * 8;
+}
+
+// store x as a float or double at p
+inline void policyPut(char* p, int value_bytes, double x){
+	if(value_bytes == 4){
+		float f = (float)x;
+		memcpy(p, &f, 4);
+	}
+	else
+		memcpy(p, &x, 8);
+}
+
+// write pi and, if given, V and Q to path with one write; value_bytes is 4 (float) or 8 (double).
+// State i is written at position order[i] if order is given
+bool writePolicy(const char* path, Params* params, const std::vector<action_t>& pi,
+                 const std::vector<value_t>* V, const QTable* Q, int value_bytes,
+                 const std::vector<state_t>* order = NULL){
+	PolicyHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, POLICY_MAGIC, 8);
+	h.len_state = params->len_state;
+	h.len_action = params->len_action;
+	h.gamma = params->gamma;
+	h.pi_bytes = params->len_action <= (1 << 8) ? 1 : params->len_action <= (1 << 16) ? 2 : 4;
+	h.value_bytes = value_bytes == 4 ? 4 : 8;
+	h.has_v = V != NULL;
+	h.has_q = Q != NULL;
+
+	size_t S = h.len_state, A = h.len_action;
+	size_t pi_size = policyPad(S * h.pi_bytes);
+	size_t v_size = h.has_v ? policyPad(S * h.value_bytes) : 0;
+	size_t q_size = h.has_q ? policyPad(S * A * h.value_bytes) : 0;
+	std::vector<char> buf(sizeof(h) + pi_size + v_size + q_size, 0);
+	memcpy(buf.data(), &h, sizeof(h));
+
+	char* p = buf.data() + sizeof(h);
+	for(size_t i = 0; i < S; i++){
+		uint32_t a = (uint32_t)pi[i];
+		size_t k = order ? (*order)[i] : i;
+		memcpy(p + k * h.pi_bytes, &a, h.pi_bytes);   // low bytes on little-endian machines
+	}
+	p += pi_size;
+	if(V){
+		for(size_t i = 0; i < S; i++)
+			policyPut(p + (order ? (*order)[i] : i) * h.value_bytes, h.value_bytes, (*V)[i]);
+		p += v_size;
+	}
+	if(Q){
+		for(size_t i = 0; i < S; i++){
+			size_t k = order ? (*order)[i] : i;
+			for(size_t a = 0; a < A; a++)
+				policyPut(p + (k * A + a) * h.value_bytes, h.value_bytes, (*Q)(i, a));
+		}
+	}
+
+	std::ofstream out(path, std::ios::binary);
+	out.write(buf.data(), buf.size());
+	out.close();
+	if(!out){
+		cout << "Cannot write policy " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+// read-only view of a policy file mapped into memory, lookups read the mapping directly
+class PolicyFile{
+
+	private:
+		const char* data;
+		size_t bytes;
+		PolicyHeader h;
+		const char* pi;
+		const char* v;
+		const char* q;
+
+		PolicyFile(const PolicyFile&);
+		PolicyFile& operator=(const PolicyFile&);
+
+		double get(const char* p, size_t k) const{
+			if(h.value_bytes == 4){
+				float f;
+				memcpy(&f, p + k * 4, 4);
+				return f;
+			}
+			double d;
+			memcpy(&d, p + k * 8, 8);
+			return d;
+		}
+
+	public:
+
+		PolicyFile() : data(NULL), bytes(0), pi(NULL), v(NULL), q(NULL) {}
+
+		~PolicyFile(){
+			close();
+		}
+
+		// map path, false if it cannot be mapped, is not a complete policy file or has more states than state_t indexes
+		bool open(const char* path){
+			close();
+			data = (const char*)mapFile(path, &bytes);
+			if(!data)
+				return false;
+			if(bytes < sizeof(h)){
+				close();
+				return false;
+			}
+			memcpy(&h, data, sizeof(h));
+			size_t S = h.len_state, A = h.len_action;
+			size_t pi_size = policyPad(S * h.pi_bytes);
+			size_t v_size = h.has_v ? policyPad(S * h.value_bytes) : 0;
+			size_t q_size = h.has_q ? policyPad(S * A * h.value_bytes) : 0;
+			if(strncmp(h.magic, POLICY_MAGIC, 8) != 0 || bytes != sizeof(h) + pi_size + v_size + q_size
+			   || (state_t)h.len_state != h.len_state){
+				close();
+				return false;
+			}
+			pi = data + sizeof(h);
+			v = h.has_v ? pi + pi_size : NULL;
+			q = h.has_q ? pi + pi_size + v_size : NULL;
+			return true;
+		}
+
+		void close(){
+			if(data)
+				unmapFile(data, bytes);
+			data = NULL;
+			pi = v = q = NULL;
+		}
+
+		state_t numStates() const{
+			return (state_t)h.len_state;
+		}
+
+		int numActions() const{
+			return h.len_action;
+		}
+
+		double gamma() const{
+			return h.gamma;
+		}
+
+		bool hasValues() const{
+			return v != NULL;
+		}
+
+		bool hasQ() const{
+			return q != NULL;
+		}
+
+		// action of state i
+		int action(state_t i) const{
+			if(h.pi_bytes == 1)
+				return (uint8_t)pi[i];
+			if(h.pi_bytes == 2){
+				uint16_t a;
+				memcpy(&a, pi + (size_t)i * 2, 2);
+				return a;
+			}
+			uint32_t a;
+			memcpy(&a, pi + (size_t)i * 4, 4);
+			return (int)a;
+		}
+
+		// V[i], only if hasValues()
+		double value(state_t i) const{
+			return get(v, i);
+		}
+
+		// Q(i, a), only if hasQ()
+		double qvalue(state_t i, int a) const{
+			return get(q, (size_t)i * h.len_action + a);
+		}
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "util.h"
+#include "numa.h"
+using namespace std;
+
+// Persistent worker threads. run(n, fn) calls fn(0), ..., fn(n-1) at the same time on n
+// pool threads and waits for them, so tasks may wait for each other at a barrier. The
+// threads are started on first need and kept for later runs, evaluations and bench
+// configurations. With pinning, pool thread t stays on CPU t modulo the CPU count.
+class WorkerPool{
+
+	private:
+		std::vector<std::thread> threads;
+		std::mutex lock;
+		std::condition_variable wake;      // a new task or quit
+		std::condition_variable done;      // the last task of a run finished
+		std::function<void(int)> task;
+		int task_n;
+		int running;                       // tasks of the current run not finished
+		long long generation;              // number of runs started
+		bool quit;
+		bool pin;
+
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		void worker(int id){
+			if(pin)
+				pinThread(id % std::max(1u, std::thread::hardware_concurrency()));
+			long long seen = 0;
+			std::unique_lock<std::mutex> guard(lock);
+			while(true){
+				wake.wait(guard, [&]{ return quit || generation != seen; });
+				if(quit)
+					return;
+				seen = generation;
+				if(id >= task_n)
+					continue;
+				std::function<void(int)> f = task;
+				guard.unlock();
+				f(id);
+				guard.lock();
+				if(--running == 0)
+					done.notify_all();
+			}
+		}
+
+	public:
+
+		WorkerPool(bool pin_ = false) : task_n(0), running(0), generation(0), quit(false), pin(pin_) {}
+
+		~WorkerPool(){
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				quit = true;
+			}
+			wake.notify_all();
+			for(size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+		}
+
+		int size() const{
+			return (int)threads.size();
+		}
+
+		// run fn(t) for t in [0, n) on n threads at once and wait for all of them
+		void run(int n, std::function<void(int)> fn){
+			std::unique_lock<std::mutex> guard(lock);
+			while((int)threads.size() < n)
+				threads.push_back(std::thread(&WorkerPool::worker, this, (int)threads.size()));
+			task = fn;
+			task_n = n;
+			running = n;
+			generation++;
+			wake.notify_all();
+			done.wait(guard, [&]{ return running == 0; });
+		}
+};
+
+// pool of the solver threads, pinned if params->pin (the first call decides)
+WorkerPool& workerPool(Params* params){
+	static WorkerPool pool(params->pin != 0);
+	return pool;
+}
+
+// pool of the evaluation episodes, separate because evaluations are started from solver threads
+WorkerPool& evalPool(){
+	static WorkerPool pool;
+	return pool;
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef PRIORITY_H
+#define PRIORITY_H
+
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include "util.h"
+using namespace std;
+
+// Prioritized sweeping schedule of -style 3 (AsyncQVI, AsyncQL). Every thread owns the
+// states of its block (stateBlock in algo.h) in a max-heap keyed by how much the last
+// sweep of a state moved V. A thread sweeps the top state of its own heap, steals the
+// top of another thread's heap when its own is empty, and sweeps its block cyclically
+// when all heaps are empty. A state whose V moved by more than params->priority_tol goes
+// back in with that change, and so does the last state seen sampling into it (its
+// predecessor), with the change discounted by gamma. All states start at the top, so
+// the first pass covers the whole space.
+
+#define PRIORITY_START 1e300
+
+// one thread's heap of (priority, state), entries older than the state's priority are skipped
+struct alignas(64) PriorityQueue{
+	std::mutex lock;
+	std::priority_queue<std::pair<double, state_t> > heap;
+	state_t lo, hi;     // block of states owned by the thread
+	state_t cursor;     // next state of the block swept when every heap is empty
+};
+
+class PrioritySweep{
+
+	private:
+		int nthreads;
+		state_t len_state;
+		double gamma;
+		double tol;
+		AlignedArray<PriorityQueue> queues;      // one cache line each (defined in util.h)
+		std::vector<double> prio;                // queued priority of each state, 0 if not queued; guarded by its owner's lock
+		std::unique_ptr<std::atomic<state_t>[]> pred;   // last state sampled into each state, -1 if none
+
+		// thread whose block holds state i
+		int owner(state_t i) const{
+			int t = (int)((long long)i * nthreads / len_state);
+			while(t + 1 < nthreads && (long long)len_state * (t + 1) / nthreads <= i)
+				t++;
+			while(t > 0 && (long long)len_state * t / nthreads > i)
+				t--;
+			return t;
+		}
+
+		// top live state of queue q, -1 if empty; q's lock is held
+		state_t take(PriorityQueue& q){
+			while(!q.heap.empty()){
+				std::pair<double, state_t> top = q.heap.top();
+				q.heap.pop();
+				if(top.first == prio[top.second]){
+					prio[top.second] = 0.;
+					return top.second;
+				}
+			}
+			return -1;
+		}
+
+	public:
+
+		PrioritySweep(Params* params) : nthreads(params->total_num_threads), len_state(params->len_state),
+		                                gamma(params->gamma), tol(params->priority_tol),
+		                                queues(alignedArray<PriorityQueue>(params->total_num_threads)),
+		                                prio(params->len_state, PRIORITY_START),
+		                                pred(new std::atomic<state_t>[params->len_state]){
+			for(int t = 0; t < nthreads; t++){
+				queues[t].lo = queues[t].cursor = (state_t)((long long)len_state * t / nthreads);
+				queues[t].hi = (state_t)((long long)len_state * (t + 1) / nthreads);
+			}
+			for(state_t i = 0; i < len_state; i++){
+				pred[i].store(-1, std::memory_order_relaxed);
+				queues[owner(i)].heap.push(std::make_pair(PRIORITY_START, i));
+			}
+		}
+
+		// queue state i with priority p, or raise its priority to p
+		void push(state_t i, double p){
+			PriorityQueue& q = queues[owner(i)];
+			std::lock_guard<std::mutex> guard(q.lock);
+			if(p <= prio[i])
+				return;
+			prio[i] = p;
+			q.heap.push(std::make_pair(p, i));
+		}
+
+		// next state for thread_id: the top of its own heap, else stolen from the others in
+		// turn, else the next state of its own block
+		state_t pop(int thread_id){
+			for(int k = 0; k < nthreads; k++){
+				PriorityQueue& q = queues[(thread_id + k) % nthreads];
+				std::lock_guard<std::mutex> guard(q.lock);
+				state_t i = take(q);
+				if(i >= 0)
+					return i;
+			}
+			PriorityQueue& q = queues[thread_id];
+			std::lock_guard<std::mutex> guard(q.lock);
+			state_t i = q.cursor;
+			q.cursor = q.cursor + 1 < q.hi ? q.cursor + 1 : q.lo;
+			return i;
+		}
+
+		// a sample of state i went to state j
+		void observe(state_t i, state_t j){
+			pred[j].store(i, std::memory_order_relaxed);
+		}
+
+		// a sweep of state i moved V[i] by delta: requeue it and its predecessor if it moved enough
+		void done(state_t i, double delta){
+			if(delta < 0)
+				delta = -delta;
+			if(delta <= tol)
+				return;
+			push(i, delta);
+			state_t p = pred[i].load(std::memory_order_relaxed);
+			if(p >= 0 && gamma * delta > tol)
+				push(p, gamma * delta);
+		}
+};
+
+#endif
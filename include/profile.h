@@ -0,0 +1,105 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <pthread.h>
+#include "util.h"
+using namespace std;
+
+// Hot-path instrumentation, compiled in with -DPROFILE (make PROFILE=1) and
+// expanding to nothing otherwise. Every thread owns one cache-line aligned slot
+// of counters, so counting never shares a line between threads. Times are taken
+// with the time stamp counter and converted to seconds in the report.
+
+enum ProfileCounter{
+	PROF_UPDATES,        // QVI/Qlearning updates
+	PROF_IMPROVED,       // updates that raised V
+	PROF_ORACLE_CALLS,   // samples drawn by SO
+	PROF_ORACLE_TICKS,   // ticks inside SO
+	PROF_UPDATE_TICKS,   // ticks inside update
+	PROF_LOCK_TICKS,     // ticks waiting for writelock
+	PROF_BARRIERS,       // barrier waits
+	PROF_BARRIER_TICKS,  // ticks waiting at barriers
+	PROF_NUM
+};
+
+#ifdef PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+inline unsigned long long profileTicks(){
+	return __rdtsc();
+}
+#else
+#include <chrono>
+inline unsigned long long profileTicks(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#define PROFILE_MAX_THREADS 256
+
+struct alignas(64) ProfileSlot{
+	unsigned long long count[PROF_NUM];
+};
+
+ProfileSlot profile_slots[PROFILE_MAX_THREADS];
+std::atomic<int> profile_threads(0);
+double profile_wall0 = get_wall_time();
+unsigned long long profile_ticks0 = profileTicks();
+
+// counters of the calling thread, a slot is handed out on first use
+inline unsigned long long* profileSlot(){
+	static thread_local int slot = -1;
+	if(slot < 0)
+		slot = profile_threads.fetch_add(1) % PROFILE_MAX_THREADS;
+	return profile_slots[slot].count;
+}
+
+#define PROF_COUNT(counter, n) (profileSlot()[counter] += (n))
+#define PROF_START(t) unsigned long long t = profileTicks()
+#define PROF_STOP(t, counter) (profileSlot()[counter] += profileTicks() - (t))
+
+// per-thread and total counters, ticks are reported in seconds
+void profileReport(){
+	double seconds_per_tick = (get_wall_time() - profile_wall0) / (double)(profileTicks() - profile_ticks0);
+	int nthreads = min(profile_threads.load(), PROFILE_MAX_THREADS);
+	unsigned long long total[PROF_NUM] = {0};
+	cout<<"profile: thread updates improved oracle_calls oracle_ns update_ns lock_wait_s barriers barrier_wait_s"<<endl;
+	for(int t = 0; t <= nthreads; t++){
+		unsigned long long* c = t < nthreads ? profile_slots[t].count : total;
+		for(int k = 0; t < nthreads && k < PROF_NUM; k++)
+			total[k] += c[k];
+		if(t < nthreads)
+			cout<<"profile: "<<t<<' ';
+		else
+			cout<<"profile: all ";
+		cout<<c[PROF_UPDATES]<<' '<<c[PROF_IMPROVED]<<' '<<c[PROF_ORACLE_CALLS]<<' '
+		    <<(c[PROF_ORACLE_CALLS] ? 1e9 * c[PROF_ORACLE_TICKS] * seconds_per_tick / c[PROF_ORACLE_CALLS] : 0.)<<' '
+		    <<(c[PROF_UPDATES] ? 1e9 * c[PROF_UPDATE_TICKS] * seconds_per_tick / c[PROF_UPDATES] : 0.)<<' '
+		    <<c[PROF_LOCK_TICKS] * seconds_per_tick<<' '<<c[PROF_BARRIERS]<<' '
+		    <<c[PROF_BARRIER_TICKS] * seconds_per_tick<<endl;
+	}
+}
+
+#else
+
+#define PROF_COUNT(counter, n) ((void)0)
+#define PROF_START(t) ((void)0)
+#define PROF_STOP(t, counter) ((void)0)
+inline void profileReport(){}
+
+#endif
+
+// pthread_barrier_wait with the wait counted by the profiler
+inline void barrierWait(pthread_barrier_t* barrier){
+	PROF_START(t);
+	pthread_barrier_wait(barrier);
+	PROF_STOP(t, PROF_BARRIER_TICKS);
+	PROF_COUNT(PROF_BARRIERS, 1);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef QTABLE_H
+#define QTABLE_H
+
+#include <math.h>
+#include <stddef.h>
+#include "util.h"
+using namespace std;
+
+#define CACHE_LINE 64                                  // bytes of a cache line
+#ifdef VALUE_FLOAT
+#define ROW_ALIGN 8                                    // floats per half cache line
+#else
+#define ROW_ALIGN (CACHE_LINE / (int)sizeof(double))   // doubles per cache line
+#endif
+
+// len_state x len_action table of value_t (util.h) in one aligned contiguous buffer.
+// Every row starts on a cache line (a half line for float, so 8 actions take 32 bytes):
+// the stride is len_action rounded up to a multiple of ROW_ALIGN and the padding entries
+// hold -inf, so a max over the full stride of a row equals the max over its len_action entries.
+class QTable{
+
+	private:
+		value_t* data;
+		state_t len_state;
+		int len_action;
+		int stride;
+
+		QTable(const QTable&);
+		QTable& operator=(const QTable&);
+
+	public:
+
+		QTable(state_t len_state_, int len_action_, double init = 0.){
+			len_state = len_state_;
+			len_action = len_action_;
+			stride = (len_action + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN;
+			data = (value_t*)alignedMalloc((size_t)len_state * stride * sizeof(value_t), CACHE_LINE);
+			for(state_t i = 0; i < len_state; i++){
+				value_t* q = row(i);
+				for(int a = 0; a < len_action; a++)
+					q[a] = init;
+				for(int a = len_action; a < stride; a++)
+					q[a] = -INFINITY;
+			}
+		}
+
+		~QTable(){
+			alignedFree(data);
+		}
+
+		// row-wise view: pointer to the len_action entries of state i
+		value_t* row(state_t i){
+			return data + (size_t)i * stride;
+		}
+
+		const value_t* row(state_t i) const{
+			return data + (size_t)i * stride;
+		}
+
+		value_t& operator()(state_t i, int a){
+			return data[(size_t)i * stride + a];
+		}
+
+		value_t operator()(state_t i, int a) const{
+			return data[(size_t)i * stride + a];
+		}
+
+		// entry (i, a) read atomically, for tables other threads update with blend
+		value_t load(state_t i, int a) const{
+			value_t q;
+			__atomic_load(data + (size_t)i * stride + a, &q, __ATOMIC_RELAXED);
+			return q;
+		}
+
+		// entry (i, a) = (1-alpha) * entry + alpha * target by compare-and-swap, so threads updating
+		// the same entry at once do not lose updates; returns the new entry
+		value_t blend(state_t i, int a, double alpha, double target){
+			value_t* p = data + (size_t)i * stride + a;
+			value_t old, q;
+			__atomic_load(p, &old, __ATOMIC_RELAXED);
+			do{
+				q = (value_t)((1 - alpha) * old + alpha * target);
+			}while(!__atomic_compare_exchange(p, &old, &q, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+			return q;
+		}
+
+		state_t rows() const{
+			return len_state;
+		}
+
+		int cols() const{
+			return len_action;
+		}
+
+		// distance between consecutive rows, a multiple of ROW_ALIGN
+		int getStride() const{
+			return stride;
+		}
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+using namespace std;
+
+// xoshiro256** generator (Blackman and Vigna): 256 bits of state, a few
+// shifts and rotations per draw. Stream k of a seed starts from a state
+// hashed from (seed, k).
+struct Xoshiro256{
+	uint64_t s[4];
+
+	static uint64_t rotl(uint64_t x, int k){
+		return (x << k) | (x >> (64 - k));
+	}
+
+	// splitmix64 finalizer
+	static uint64_t mix(uint64_t z){
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	// state of stream `stream` of seed, independent of the other streams of seed
+	void seed(uint64_t seed, uint64_t stream){
+		this->seed(mix(seed) ^ mix(stream * 0xd1342543de82ef95ULL + 0x632be59bd9b4e019ULL));
+	}
+
+	// fill the state from one 64-bit seed with splitmix64
+	void seed(uint64_t seed){
+		for(int k = 0; k < 4; k++)
+			s[k] = mix(seed += 0x9e3779b97f4a7c15ULL);
+	}
+
+	uint64_t next(){
+		uint64_t result = rotl(s[1] * 5, 7) * 9;
+		uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	// uniform double in [0, 1)
+	double uniform(){
+		return (next() >> 11) * (1. / 9007199254740992.);
+	}
+};
+
+#define ALIAS_MAX 32   // largest number of outcomes of an AliasTable
+
+// Walker/Vose alias table: draws one of n weighted integer outcomes
+// first, ..., first+n-1 in O(1) from a single 64-bit random number
+struct AliasTable{
+	int n = 1;
+	int first = 0;
+	double prob[ALIAS_MAX];
+	int alias[ALIAS_MAX];
+
+	void build(const double* w, int n_, int first_){
+		n = n_;
+		first = first_;
+		double total = 0.;
+		for(int k = 0; k < n; k++)
+			total += w[k];
+		int small[ALIAS_MAX], large[ALIAS_MAX];
+		int ns = 0, nl = 0;
+		for(int k = 0; k < n; k++){
+			prob[k] = w[k] * n / total;
+			alias[k] = k;
+			if(prob[k] < 1.)
+				small[ns++] = k;
+			else
+				large[nl++] = k;
+		}
+		while(ns > 0 && nl > 0){
+			int s = small[--ns], l = large[--nl];
+			alias[s] = l;
+			prob[l] -= 1. - prob[s];
+			if(prob[l] < 1.)
+				small[ns++] = l;
+			else
+				large[nl++] = l;
+		}
+		// left over columns are full up to rounding
+		while(ns > 0)
+			prob[small[--ns]] = 1.;
+		while(nl > 0)
+			prob[large[--nl]] = 1.;
+	}
+
+	// high 32 bits pick the column, low 32 bits flip its coin
+	int sample(uint64_t bits) const{
+		int k = (int)(((bits >> 32) * (uint64_t)n) >> 32);
+		double u = (bits & 0xffffffffULL) * (1. / 4294967296.);
+		return first + (u < prob[k] ? k : alias[k]);
+	}
+
+	// outcomes of (int)X for X ~ N(0, sd), truncation toward zero as in a cast;
+	// mass beyond 10 standard deviations is dropped, so sd is at most 1.5 for ALIAS_MAX 32
+	void buildTruncatedNormal(double sd){
+		int K = (int)ceil(10. * sd);
+		if(K > (ALIAS_MAX - 1) / 2){
+			cout << "Normal of sd " << sd << " needs " << 2 * K + 1 << " outcomes, an AliasTable holds " << ALIAS_MAX << endl;
+			exit(1);
+		}
+		double w[ALIAS_MAX];
+		double c = 1. / (sd * sqrt(2.));
+		w[K] = erf(c);
+		for(int k = 1; k <= K; k++)
+			w[K + k] = w[K - k] = 0.5 * (erfc(k * c) - erfc((k + 1) * c));
+		build(w, 2 * K + 1, -K);
+	}
+};
+
+#endif
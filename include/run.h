@@ -0,0 +1,190 @@
+#ifndef RUN_H
+#define RUN_H
+
+#include <thread>
+#include <vector>
+#include <memory>
+#include <limits>
+#include "async.h"
+#include "algo.h"
+#include "qtable.h"
+#include "packed.h"
+#include "policy.h"
+#include "pool.h"
+using namespace std;
+
+// bring the results back to the oracle's own state order: write V and Q with pi to
+// policy.bin if params.save is 2 (defined in policy.h), then reorder pi in place
+template <class Oracle>
+void finish(Params& params, std::vector<action_t>& pi, const std::vector<value_t>* V, const QTable* Q){
+	Oracle s;
+	s.setValues(&params);
+	// the order is only built if it is not the identity, it takes a state_t per state
+	bool identity = true;
+	for(state_t i = 0; i < params.len_state && identity; i++)
+		identity = s.originalIndex(i) == i;
+	std::vector<state_t> order(identity ? 0 : params.len_state);
+	for(state_t i = 0; i < (state_t)order.size(); i++)
+		order[i] = s.originalIndex(i);
+	if(params.save == 2)
+		writePolicy("policy.bin", &params, pi, V, Q, params.save_bytes, identity ? NULL : &order);
+	if(identity)
+		return;
+	std::vector<action_t> pi_order(pi.size());
+	for(state_t i = 0; i < params.len_state; i++)
+		pi_order[order[i]] = pi[i];
+	pi.swap(pi_order);
+}
+
+// run the algorithm chosen by params.algo on sample oracle Oracle, the final policy is left in pi
+template <class Oracle>
+void run(Params& params, std::vector<action_t>& pi){
+	
+	// the actions must fit in action_t (defined in util.h)
+	if((long long)params.len_action - 1 > (long long)std::numeric_limits<action_t>::max()){
+		cout<<"len_action "<<params.len_action<<" does not fit in "<<sizeof(action_t)<<"-byte actions, rebuild with a larger ACTION"<<endl;
+		exit(1);
+	}
+	// the packed V/pi slots of -lockfree, -store and -numa keep an action in ACTION_BITS bits (defined in packed.h)
+	bool packed = params.algo == 0 ? params.lockfree || !params.store.empty() || params.numa : params.algo == 1 && params.lockfree;
+	if(packed && (long long)params.len_action > (1LL << ACTION_BITS)){
+		cout<<"len_action "<<params.len_action<<" does not fit in the "<<ACTION_BITS<<"-bit actions of the packed table, run without -lockfree, -store and -numa"<<endl;
+		exit(1);
+	}
+	
+	// convergence monitor of AsyncQVI and AsyncQL (defined in converge.h)
+	std::unique_ptr<ConvergenceMonitor> monitor(params.converge_tol >= 0 ? new ConvergenceMonitor(&params) : NULL);
+	
+	 if(params.algo == 0){ // run AsyncQVI
+		// state value, V[i] = max_a Q(i,a), left empty when V lives in the store file
+		bool stored = !params.store.empty();
+		std::vector<value_t> V(stored ? 0 : params.len_state, 0.); 
+		
+		// NUMA shards of the state space (defined in numa.h), updated lock-free by whichever thread claims a chunk
+		std::unique_ptr<NumaShards> shards;
+		if(params.numa){
+			params.lockfree = 1;
+			params.deterministic = 0;
+			shards.reset(new NumaShards(&params));
+		}
+		
+		// packed V and pi for lock-free updates (defined in packed.h), mapped from the file params.store if set
+		if(stored)
+			params.lockfree = 1;
+		std::unique_ptr<PackedTable> table(stored ? new PackedTable(params.len_state, params.store, params.resume != 0, &params)
+		                                          : new PackedTable(params.lockfree ? params.len_state : 0));
+		
+		// prioritized sweeping schedule of style 3 (defined in priority.h)
+		std::unique_ptr<PrioritySweep> sweep(params.style == 3 ? new PrioritySweep(&params) : NULL);
+		
+		// QVI object (defined in algo.h)
+		QVI<Oracle> obj(&V, &pi, &params, params.lockfree ? table.get() : NULL, sweep.get());
+		if(params.resume)
+			resume(obj, &params, &iter);  // restore from params.checkpoint (defined in checkpoint.h)
+		
+		// run the workers on the pool (defined in pool.h), each on its own copy of obj that
+		// it reseeds with stream i, and the evaluator thread after them
+		int n = params.total_num_threads;
+		workerPool(&params).run(n + (params.eval_thread ? 1 : 0), [&](int i){
+			if(i < n)
+				asyncQVI<Oracle>(i, obj, &params, shards.get(), monitor.get());
+			else
+				asyncEval<QVI<Oracle> >(obj, &params);
+		});
+		if(params.lockfree)
+			table->unpack(stored ? NULL : &V, &pi);
+		table->flush();
+		finish<Oracle>(params, pi, stored ? NULL : &V, NULL);
+	}
+	
+	else if(params.algo == 1){ // run Async Q-learning
+		// Q value
+		QTable Q(params.len_state, params.len_action, 0.);
+		// state value, V[i] = max_a Q(i,a)
+		std::vector<value_t> V(params.len_state);
+		
+		// packed V and pi for lock-free updates (defined in packed.h)
+		PackedTable table(params.lockfree ? params.len_state : 0);
+		
+		// prioritized sweeping schedule of style 3 (defined in priority.h)
+		std::unique_ptr<PrioritySweep> sweep(params.style == 3 ? new PrioritySweep(&params) : NULL);
+		
+		// Qlearning object (defined in algo.h)
+		Qlearning<Oracle> obj(&Q, &V, &pi, &params, params.lockfree ? &table : NULL, sweep.get());
+		if(params.resume)
+			resume(obj, &params, &iter);  // restore from params.checkpoint (defined in checkpoint.h)
+		
+		// run the workers on the pool (defined in pool.h), each on its own copy of obj that
+		// it reseeds with stream i, and the evaluator thread after them
+		int n = params.total_num_threads;
+		workerPool(&params).run(n + (params.eval_thread ? 1 : 0), [&](int i){
+			if(i < n)
+				asyncQL<Oracle>(i, obj, &params, monitor.get());
+			else
+				asyncEval<Qlearning<Oracle> >(obj, &params);
+		});
+		if(params.lockfree)
+			table.unpack(&V, &pi);
+		finish<Oracle>(params, pi, &V, &Q);
+	}
+	
+	else if(params.algo == 2){ // run VRVI: Variance Reduced Value Iteration..., Sidford et al. 2018
+		// \tilde{x} in Alg.8 
+		QTable x(params.len_state, params.len_action, 0.);
+		// v_k in Alg.9
+		std::vector<value_t> v_outer(params.len_state, 0.);
+		// v_t in Alg.8, and the buffer its inner iterations alternate with
+		std::vector<value_t> v_inner(params.len_state, 0.);
+		std::vector<value_t> v_next(params.len_state, 0.);
+		
+		// VRVI object (defined in algo.h)
+		VRVI<Oracle> obj(&x, &v_outer, &v_inner, &v_next, &pi, &params); 
+		if(params.resume)
+			resume(obj, &params, &iter);  // restore from params.checkpoint (defined in checkpoint.h)
+		
+		// draws kept per (state, action) for the rest of the schedule, whose counts grow 4x (defined in samples.h)
+		std::unique_ptr<SampleCache> cache(params.sample_cache > 0 ? new SampleCache(&params, 4) : NULL);
+		obj.cache = cache.get();
+		
+		// run the threads on the pool (defined in pool.h), each sweeping a block of states
+		workerPool(&params).run(params.total_num_threads, [&](int i){
+			syncSolve<VRVI<Oracle> >(i, obj);
+		});
+		if(cache){
+			params.samples_reused = cache->reused();
+			cout<<"sample cache "<<cache->capacity()<<" draws per pair, "<<cache->reused()<<" draws reused"<<endl;
+		}
+		finish<Oracle>(params, pi, &v_inner, NULL);
+	}
+	
+	else{ // run VRQVI: Near-Optimal Time and Sample Complexities..., Sidford et al. 2018
+		// Q, w in Alg.1
+		QTable Q(params.len_state, params.len_action, 0.);
+		QTable w(params.len_state, params.len_action, 0.);
+		// v^i in Alg.2
+		std::vector<value_t> v_outer(params.len_state, 0.);
+		// v^i in Alg.1
+		std::vector<value_t> v_inner(params.len_state, 0.);
+		
+		// VRQVI object (defined in algo.h)
+		VRQVI<Oracle> obj(&Q, &w, &v_outer, &v_inner, &pi, &params); 
+		if(params.resume)
+			resume(obj, &params, &iter);  // restore from params.checkpoint (defined in checkpoint.h)
+		
+		// draws kept per (state, action) for the rest of the schedule, whose counts grow 2x (defined in samples.h)
+		std::unique_ptr<SampleCache> cache(params.sample_cache > 0 ? new SampleCache(&params, 2) : NULL);
+		obj.cache = cache.get();
+		
+		// run the threads on the pool (defined in pool.h), each sweeping a block of states
+		workerPool(&params).run(params.total_num_threads, [&](int i){
+			syncSolve<VRQVI<Oracle> >(i, obj);
+		});
+		if(cache){
+			params.samples_reused = cache->reused();
+			cout<<"sample cache "<<cache->capacity()<<" draws per pair, "<<cache->reused()<<" draws reused"<<endl;
+		}
+		finish<Oracle>(params, pi, &v_inner, &Q);
+	}
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include "util.h"
+using namespace std;
+
+// Sample store of VRVI and VRQVI (-sample_cache MB). Every (state, action) keeps its first
+// draws of the oracle, and every phase reads a prefix of that stream: the kept draws first,
+// then fresh ones that are kept while there is room. The growing sample counts and the
+// repeated inner iterations thus only draw what no earlier phase drew. The draws live in
+// zeroed pages, or in the scratch file -sample_cache_file so the store can exceed memory.
+// A pair is only touched by the thread owning its state, so no locks are needed.
+
+// one kept draw, the reward in the value type so it comes back as drawn: 16 bytes, 8 with VALUE=float
+// and 32-bit states
+struct SampleDraw{
+	state_t next;
+	value_t reward;
+};
+
+class SampleCache{
+
+	private:
+		long long pairs;
+		int len_action;
+		int cap;                         // draws kept per pair
+		SampleDraw* draws;               // cap draws of pair p from draws + p*cap
+		std::vector<int> count;          // draws kept of each pair
+		size_t bytes;
+		bool mapped;                     // draws live in the scratch file
+		std::atomic<long long> served;   // kept draws handed out, added once per thread by addReused
+
+		SampleCache(const SampleCache&);
+		SampleCache& operator=(const SampleCache&);
+
+	public:
+
+		// room for the draws of params' schedule, whose counts grow by growth every outer
+		// iteration, as far as params->sample_cache MB allow
+		SampleCache(Params* params, int growth) : pairs((long long)params->len_state * params->len_action),
+		                                         len_action(params->len_action), draws(NULL), bytes(0),
+		                                         mapped(false), served(0){
+			long long budget = (long long)params->sample_cache * (1 << 20) / sizeof(SampleDraw) / max(1LL, pairs);
+			long long need = max(params->sample_num_1, params->sample_num_2);
+			for(long long t = params->outer + 1; t < params->max_outer_iter && need < budget; t++)
+				need *= growth;
+			cap = (int)min(min(budget, need), (long long)INT32_MAX);
+			count.assign(pairs, 0);
+			if(cap == 0)
+				return;
+			bytes = (size_t)pairs * cap * sizeof(SampleDraw);
+			if(params->sample_cache_file.empty())
+				draws = (SampleDraw*)allocPages(bytes);
+			else{
+				draws = (SampleDraw*)mapStore(params->sample_cache_file.c_str(), bytes, false);
+				if(!draws){
+					cout << "Cannot map sample cache " << params->sample_cache_file << endl;
+					exit(1);
+				}
+				mapped = true;
+			}
+		}
+
+		~SampleCache(){
+			if(mapped)
+				unmapStore(draws, bytes);
+			else
+				freePages(draws, bytes);
+		}
+
+		int capacity() const{
+			return cap;
+		}
+
+		long long reused() const{
+			return served;
+		}
+
+		// add the n kept draws a thread was handed, once at its end
+		void addReused(long long n){
+			served.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		// copy up to n kept draws of (i, a) to j and r, return how many; the caller counts them
+		int get(state_t i, int a, int n, state_t* j, double* r){
+			long long p = (long long)i * len_action + a;
+			int m = min(n, count[p]);
+			const SampleDraw* d = draws + p * cap;
+			for(int k = 0; k < m; k++){
+				j[k] = d[k].next;
+				r[k] = d[k].reward;
+			}
+			return m;
+		}
+
+		// keep the m draws of (i, a) that follow the kept ones, as far as there is room
+		void put(state_t i, int a, int m, const state_t* j, const double* r){
+			long long p = (long long)i * len_action + a;
+			SampleDraw* d = draws + p * cap;
+			int k0 = count[p];
+			int k1 = min(cap, k0 + m);
+			for(int k = k0; k < k1; k++){
+				d[k].next = j[k - k0];
+				d[k].reward = (value_t)r[k - k0];
+			}
+			count[p] = k1;
+		}
+};
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <math.h>
+#include "util.h"
+using namespace std;
+
+// vectorized kernels for the full-table sweeps of VRVI and VRQVI.
+// AVX2 and AVX-512 versions are compiled with function target attributes
+// (no extra compiler flags) and chosen at runtime from the cpu features.
+// They are optimized even in the default unoptimized build, where the
+// intrinsics would otherwise spill every vector to the stack.
+// The vector kernels are written for double tables and 32-bit state indices, a VALUE=float
+// or STATE=64 build uses the scalar ones.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(VALUE_FLOAT) && !defined(STATE_INT64)
+#define SIMD_X86
+#include <immintrin.h>
+#define SIMD_TARGET(isa) __attribute__((target(isa), optimize("O3")))
+#endif
+
+#define SIMD_SCALAR 0
+#define SIMD_AVX2 1
+#define SIMD_AVX512 2
+
+struct SimdKernels{
+	const char* name;
+	// max and first argmax of q[0..len), q is a QTable row: aligned, padded with -inf up to stride
+	int (*rowArgmax)(const value_t* q, int len, int stride, double* vmax);
+	// sum of x[0..n)
+	double (*sum)(const double* x, int n);
+	// sum of v[idx[k]]
+	double (*gatherSum)(const value_t* v, const state_t* idx, int n);
+	// sum of a[idx[k]] - b[idx[k]]
+	double (*gatherDiffSum)(const value_t* a, const value_t* b, const state_t* idx, int n);
+	// sum and sum of squares of v[idx[k]]
+	void (*gatherMoments)(const value_t* v, const state_t* idx, int n, double* sum, double* sum_sq);
+};
+
+/* scalar fallback */
+
+int rowArgmaxScalar(const value_t* q, int len, int /* stride */, double* vmax){
+	int best = 0;
+	for(int a = 1; a < len; a++)
+		if(q[a] > q[best])
+			best = a;
+	*vmax = q[best];
+	return best;
+}
+
+double sumScalar(const double* x, int n){
+	double s = 0.;
+	for(int k = 0; k < n; k++)
+		s += x[k];
+	return s;
+}
+
+double gatherSumScalar(const value_t* v, const state_t* idx, int n){
+	double s = 0.;
+	for(int k = 0; k < n; k++)
+		s += v[idx[k]];
+	return s;
+}
+
+double gatherDiffSumScalar(const value_t* a, const value_t* b, const state_t* idx, int n){
+	double s = 0.;
+	for(int k = 0; k < n; k++)
+		s += a[idx[k]] - b[idx[k]];
+	return s;
+}
+
+void gatherMomentsScalar(const value_t* v, const state_t* idx, int n, double* sum, double* sum_sq){
+	double s = 0., s2 = 0.;
+	for(int k = 0; k < n; k++){
+		double x = v[idx[k]];
+		s += x;
+		s2 += x * x;
+	}
+	*sum = s;
+	*sum_sq = s2;
+}
+
+#ifdef SIMD_X86
+
+/* AVX2: 4 doubles per vector */
+
+SIMD_TARGET("avx2") double hsumAVX2(__m256d x){
+	__m128d h = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+}
+
+SIMD_TARGET("avx2") int rowArgmaxAVX2(const double* q, int len, int stride, double* vmax){
+	__m256d m = _mm256_load_pd(q);
+	for(int a = 4; a < stride; a += 4)
+		m = _mm256_max_pd(m, _mm256_load_pd(q + a));
+	__m128d h = _mm_max_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+	double best = _mm_cvtsd_f64(_mm_max_sd(h, _mm_unpackhi_pd(h, h)));
+	// first lane holding the max
+	__m256d b = _mm256_set1_pd(best);
+	for(int a = 0; a < stride; a += 4){
+		int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_load_pd(q + a), b, _CMP_EQ_OQ));
+		if(mask){
+			*vmax = best;
+			return a + __builtin_ctz(mask);
+		}
+	}
+	return rowArgmaxScalar(q, len, stride, vmax);
+}
+
+SIMD_TARGET("avx2") double sumAVX2(const double* x, int n){
+	__m256d acc = _mm256_setzero_pd();
+	int k = 0;
+	for(; k + 4 <= n; k += 4)
+		acc = _mm256_add_pd(acc, _mm256_loadu_pd(x + k));
+	double s = hsumAVX2(acc);
+	for(; k < n; k++)
+		s += x[k];
+	return s;
+}
+
+SIMD_TARGET("avx2") double gatherSumAVX2(const double* v, const int* idx, int n){
+	__m256d acc = _mm256_setzero_pd();
+	int k = 0;
+	for(; k + 4 <= n; k += 4){
+		__m128i i = _mm_loadu_si128((const __m128i*)(idx + k));
+		acc = _mm256_add_pd(acc, _mm256_i32gather_pd(v, i, 8));
+	}
+	double s = hsumAVX2(acc);
+	for(; k < n; k++)
+		s += v[idx[k]];
+	return s;
+}
+
+SIMD_TARGET("avx2") double gatherDiffSumAVX2(const double* a, const double* b, const int* idx, int n){
+	__m256d acc = _mm256_setzero_pd();
+	int k = 0;
+	for(; k + 4 <= n; k += 4){
+		__m128i i = _mm_loadu_si128((const __m128i*)(idx + k));
+		acc = _mm256_add_pd(acc, _mm256_sub_pd(_mm256_i32gather_pd(a, i, 8), _mm256_i32gather_pd(b, i, 8)));
+	}
+	double s = hsumAVX2(acc);
+	for(; k < n; k++)
+		s += a[idx[k]] - b[idx[k]];
+	return s;
+}
+
+SIMD_TARGET("avx2,fma") void gatherMomentsAVX2(const double* v, const int* idx, int n, double* sum, double* sum_sq){
+	__m256d acc = _mm256_setzero_pd();
+	__m256d acc2 = _mm256_setzero_pd();
+	int k = 0;
+	for(; k + 4 <= n; k += 4){
+		__m256d x = _mm256_i32gather_pd(v, _mm_loadu_si128((const __m128i*)(idx + k)), 8);
+		acc = _mm256_add_pd(acc, x);
+		acc2 = _mm256_fmadd_pd(x, x, acc2);
+	}
+	double s = hsumAVX2(acc), s2 = hsumAVX2(acc2);
+	for(; k < n; k++){
+		s += v[idx[k]];
+		s2 += v[idx[k]] * v[idx[k]];
+	}
+	*sum = s;
+	*sum_sq = s2;
+}
+
+/* AVX-512: 8 doubles per vector, QTable strides are multiples of 8 */
+
+SIMD_TARGET("avx512f") int rowArgmaxAVX512(const double* q, int len, int stride, double* vmax){
+	__m512d m = _mm512_load_pd(q);
+	for(int a = 8; a < stride; a += 8)
+		m = _mm512_mask_max_pd(m, 0xFF, m, _mm512_load_pd(q + a));   // full mask, see gatherAVX512
+	double best = _mm512_reduce_max_pd(m);
+	__m512d b = _mm512_set1_pd(best);
+	for(int a = 0; a < stride; a += 8){
+		unsigned mask = _mm512_cmp_pd_mask(_mm512_load_pd(q + a), b, _CMP_EQ_OQ);
+		if(mask){
+			*vmax = best;
+			return a + __builtin_ctz(mask);
+		}
+	}
+	return rowArgmaxScalar(q, len, stride, vmax);
+}
+
+SIMD_TARGET("avx512f") double sumAVX512(const double* x, int n){
+	__m512d acc = _mm512_setzero_pd();
+	int k = 0;
+	for(; k + 8 <= n; k += 8)
+		acc = _mm512_add_pd(acc, _mm512_loadu_pd(x + k));
+	double s = _mm512_reduce_add_pd(acc);
+	for(; k < n; k++)
+		s += x[k];
+	return s;
+}
+
+// v[i] for the 8 indices i, a full-mask gather into zeros: the plain gather starts from an
+// undefined vector, which gcc reports as maybe uninitialized
+SIMD_TARGET("avx512f") __m512d gatherAVX512(const double* v, __m256i i){
+	return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, i, v, 8);
+}
+
+SIMD_TARGET("avx512f") double gatherSumAVX512(const double* v, const int* idx, int n){
+	__m512d acc = _mm512_setzero_pd();
+	int k = 0;
+	for(; k + 8 <= n; k += 8){
+		__m256i i = _mm256_loadu_si256((const __m256i*)(idx + k));
+		acc = _mm512_add_pd(acc, gatherAVX512(v, i));
+	}
+	double s = _mm512_reduce_add_pd(acc);
+	for(; k < n; k++)
+		s += v[idx[k]];
+	return s;
+}
+
+SIMD_TARGET("avx512f") double gatherDiffSumAVX512(const double* a, const double* b, const int* idx, int n){
+	__m512d acc = _mm512_setzero_pd();
+	int k = 0;
+	for(; k + 8 <= n; k += 8){
+		__m256i i = _mm256_loadu_si256((const __m256i*)(idx + k));
+		acc = _mm512_add_pd(acc, _mm512_sub_pd(gatherAVX512(a, i), gatherAVX512(b, i)));
+	}
+	double s = _mm512_reduce_add_pd(acc);
+	for(; k < n; k++)
+		s += a[idx[k]] - b[idx[k]];
+	return s;
+}
+
+SIMD_TARGET("avx512f") void gatherMomentsAVX512(const double* v, const int* idx, int n, double* sum, double* sum_sq){
+	__m512d acc = _mm512_setzero_pd();
+	__m512d acc2 = _mm512_setzero_pd();
+	int k = 0;
+	for(; k + 8 <= n; k += 8){
+		__m512d x = gatherAVX512(v, _mm256_loadu_si256((const __m256i*)(idx + k)));
+		acc = _mm512_add_pd(acc, x);
+		acc2 = _mm512_fmadd_pd(x, x, acc2);
+	}
+	double s = _mm512_reduce_add_pd(acc), s2 = _mm512_reduce_add_pd(acc2);
+	for(; k < n; k++){
+		s += v[idx[k]];
+		s2 += v[idx[k]] * v[idx[k]];
+	}
+	*sum = s;
+	*sum_sq = s2;
+}
+
+#endif
+
+// pick the widest kernels supported by the cpu, not above level (-1: no limit)
+SimdKernels selectKernels(int level){
+#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if((level < 0 || level >= SIMD_AVX512) && __builtin_cpu_supports("avx512f")){
+		SimdKernels k = {"avx512", rowArgmaxAVX512, sumAVX512, gatherSumAVX512, gatherDiffSumAVX512, gatherMomentsAVX512};
+		return k;
+	}
+	if((level < 0 || level >= SIMD_AVX2) && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+		SimdKernels k = {"avx2", rowArgmaxAVX2, sumAVX2, gatherSumAVX2, gatherDiffSumAVX2, gatherMomentsAVX2};
+		return k;
+	}
+#else
+	(void)level;   // no vector kernels in this build
+#endif
+	SimdKernels k = {"scalar", rowArgmaxScalar, sumScalar, gatherSumScalar, gatherDiffSumScalar, gatherMomentsScalar};
+	return k;
+}
+
+#endif
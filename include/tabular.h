@@ -0,0 +1,204 @@
+#ifndef TABULAR_H
+#define TABULAR_H
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include <stdint.h>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include "util.h"
+#include "oracle.h"
+using namespace std;
+
+// Binary transition table of a tabular MDP, in native byte order. The file is
+// mapped read-only, nothing is parsed or copied at startup. Pair p = i*len_action + a.
+//   TabularHeader
+//   uint64 offsets[len_state*len_action + 1]  entries of pair p are [offsets[p], offsets[p+1])
+//   double reward[len_state*len_action]       reward of pair p
+//   double cdf[nnz]                           cumulative transition probability, last entry of a pair is 1
+//   int32  next[nnz]                          next state of every entry, so a file holds at most 2^31-1 states
+#define TABULAR_MAGIC "MDPCSR1"
+
+struct TabularHeader{
+	char magic[8];       // TABULAR_MAGIC
+	int64_t len_state;   // number of states
+	int64_t len_action;  // number of actions
+	int64_t nnz;         // number of (state, action, next state) entries
+};
+
+// read-only mapping of a transition file, shared by all copies of an oracle
+struct MappedFile{
+	const char* data;
+	size_t bytes;
+
+	MappedFile(const char* data_, size_t bytes_) : data(data_), bytes(bytes_) {}
+	~MappedFile(){
+		unmapFile(data, bytes);
+	}
+};
+
+// sample oracle for an MDP given by an explicit sparse transition table
+class TabularMDP{
+
+	private:
+		state_t len_state;
+		int len_action;
+		std::shared_ptr<MappedFile> file;
+		const uint64_t* offsets;
+		const double* rewards;
+		const double* cdf;
+		const int32_t* next;
+		uint64_t nnz;
+		std::string path;        // of the file, for messages
+
+		// local random generator, faster for parallel computing
+		std::mt19937 local_rng;
+		std::uniform_real_distribution<double> unit{0., 1.};
+
+		// exit on a malformed file, naming what is wrong; by _Exit, as this may run on a solver thread
+		// and the destructors of the thread pools (pool.h) would wait for the solver threads
+		void malformed(const char* error) const{
+			cout << "Malformed MDP file " << path << ": " << error << endl;
+			_Exit(1);
+		}
+
+		// entries [lo, hi) of pair p; the offsets are only checked here, when the pair is drawn,
+		// so loading does not read the whole file
+		void entries(uint64_t p, uint64_t* lo, uint64_t* hi) const{
+			*lo = offsets[p];
+			*hi = offsets[p+1];
+			if(*hi <= *lo || *hi > nnz)
+				malformed("a (state, action) has no entry or its offsets are out of range");
+		}
+
+		// entry of [lo, hi) hit by u in [0, 1): first cdf entry above u, its next state checked
+		state_t draw(uint64_t lo, uint64_t hi, double u) const{
+			// the last entry is taken if rounding left the cdf slightly below 1
+			const double* k = upper_bound(cdf + lo, cdf + hi - 1, u);
+			state_t j = next[k - cdf];
+			if(j < 0 || j >= len_state)
+				malformed("a next state is out of range");
+			return j;
+		}
+
+		// map params->mdp and check its size and outer offsets against its header, exits on a malformed file
+		void load(Params* params){
+			size_t bytes = 0;
+			const char* data = (const char*)mapFile(params->mdp.c_str(), &bytes);
+			if(!data){
+				cout << "Cannot map MDP file " << params->mdp << endl;
+				exit(1);
+			}
+			file = std::make_shared<MappedFile>(data, bytes);
+			TabularHeader h;
+			memcpy(&h, data, bytes < sizeof(h) ? bytes : sizeof(h));
+			uint64_t pairs = (uint64_t)h.len_state * h.len_action;
+			if(bytes < sizeof(h) || strncmp(h.magic, TABULAR_MAGIC, 8) != 0
+			   || h.len_state <= 0 || h.len_state > INT32_MAX || h.len_action <= 0 || h.len_action > INT32_MAX || h.nnz < 0
+			   || bytes != sizeof(h) + (pairs + 1) * 8 + pairs * 8 + h.nnz * 12){
+				cout << "Malformed MDP file " << params->mdp << endl;
+				exit(1);
+			}
+			len_state = (state_t)h.len_state;
+			len_action = (int)h.len_action;
+			offsets = (const uint64_t*)(data + sizeof(h));
+			rewards = (const double*)(offsets + pairs + 1);
+			cdf = rewards + pairs;
+			next = (const int32_t*)(cdf + h.nnz);
+			nnz = (uint64_t)h.nnz;
+			path = params->mdp;
+			if(offsets[0] != 0 || offsets[pairs] != nnz)
+				malformed("offsets do not span the entries");
+		}
+
+	public:
+
+		TabularMDP() : len_state(0), len_action(0), offsets(NULL), rewards(NULL), cdf(NULL), next(NULL), nnz(0) {}
+
+		// set len_state and len_action of params from the header of params->mdp
+		static void setSize(Params* params){
+			TabularMDP mdp;
+			mdp.load(params);
+			params->len_state = mdp.len_state;
+			params->len_action = mdp.len_action;
+		}
+
+		// map the table on first use, reseed on every call
+		void setValues(Params* params){
+			if(!file)
+				load(params);
+			std::random_device rd;
+			local_rng.seed(rd());
+		}
+
+		// reproducible stream: stream k of seed, streams of one seed are independent
+		void seed(uint64_t seed, uint64_t stream){
+			std::seed_seq seq{(uint32_t)seed, (uint32_t)(seed >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+			local_rng.seed(seq);
+			unit.reset();
+		}
+
+		state_t numStates() const{
+			return len_state;
+		}
+
+		int numActions() const{
+			return len_action;
+		}
+		
+		// states keep the order of the file
+		state_t originalIndex(state_t i) const{
+			return i;
+		}
+
+		state_t localUniformInt(state_t start, state_t end){
+			std::uniform_int_distribution<state_t> uni(start, end);
+			return uni(local_rng);
+		}
+
+		double localUniformDouble(double start, double end){
+			std::uniform_real_distribution<double> unif(start, end);
+			return unif(local_rng);
+		}
+
+		// sample oracle function: given init_state[i], init_action[a], rewrite next_state[j] and reward[r]
+		void SO(state_t i, int a, state_t& j, double& r){
+			PROF_START(t);
+			uint64_t p = (uint64_t)i * len_action + a;
+			uint64_t lo, hi;
+			entries(p, &lo, &hi);
+			j = draw(lo, hi, unit(local_rng));
+			r = rewards[p];
+			PROF_STOP(t, PROF_ORACLE_TICKS);
+			PROF_COUNT(PROF_ORACLE_CALLS, 1);
+		}
+
+		// m samples of the same (i, a): the row of the pair is located once
+		void SO(state_t i, int a, int m, state_t* j, double* r){
+			uint64_t p = (uint64_t)i * len_action + a;
+			uint64_t lo, hi;
+			entries(p, &lo, &hi);
+			PROF_START(t);
+			for(int k = 0; k < m; k++){
+				j[k] = draw(lo, hi, unit(local_rng));
+				r[k] = rewards[p];
+			}
+			PROF_STOP(t, PROF_ORACLE_TICKS);
+			PROF_COUNT(PROF_ORACLE_CALLS, m);
+		}
+
+		// one sample for each of the n pairs (i[k], a[k]) into j[k] and r[k]
+		void SO(const state_t* i, const int* a, int n, state_t* j, double* r){
+			for(int k = 0; k < n; k++)
+				SO(i[k], a[k], j[k], r[k]);
+		}
+
+		// policy evaluation by episodes on copies of this oracle
+		double test(std::vector<action_t>* pi, Params* params){
+			return test_policy(*this, pi, params);
+		}
+};
+
+#endif
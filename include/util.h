@@ -5,26 +5,66 @@
 #include <stdlib.h>
 #include <iostream>
 #include <random>
+#include <new>
+#include <memory>
+#include <string>
+#include <stdint.h>
 #include "util.h"
 using namespace std;
 
 extern std::mt19937 global_rng; 
 
+// element types of the value tables (V, Q, w, x) and of the policy pi, chosen at build time:
+// make VALUE=float halves the value tables, make ACTION=8 or ACTION=16 stores an action in 1 or 2 bytes
+#ifdef VALUE_FLOAT
+typedef float value_t;
+#else
+typedef double value_t;
+#endif
+#if defined(ACTION_UINT8)
+typedef uint8_t action_t;
+#elif defined(ACTION_UINT16)
+typedef uint16_t action_t;
+#else
+typedef int action_t;
+#endif
+// state indices, int by default: make STATE=64 indexes states in 64 bits, for more than 2^31-1 states
+#ifdef STATE_INT64
+typedef long long state_t;
+#else
+typedef int state_t;
+#endif
+
 struct Params{
 	/* sample oracle hyperparameters */
-	int len_state;				// dimension of state space
+	state_t len_state;			// dimension of state space
 	int len_action;				// dimension of action space
 	double probs = 0.;  		// probability of being trapped in vortex in sailing problem
 	double d = 0.05;            // reward scale
 	double gamma = 0.99;		// discounted factor
 	int test_max_episode = 100; // test episodes
 	int test_max_step = 200;	// how many steps to go in one test episode
+	int eval_threads = 1;       // threads sharing the test episodes
+	long long seed = -1;        // base seed of all random streams, std::random_device is used if negative
+	int layout = 0;             // sailing state order: 0 wind-major, n > 0 n x n grid tiles with wind innermost; outputs stay wind-major
+	int fast_rng = 0;           // sailing oracle random numbers: 0 mt19937 and std distributions, 1 xoshiro256** and alias tables
 	
 	/* algorithms hyperparameters */
 	int algo;					// which algorithm to run
-	int style;         			// sample style: 0 uniform, 1 cyclic, 2 markovian
+	int style;         			// sample style: 0 uniform, 1 cyclic, 2 markovian, 3 prioritized sweeping (AsyncQVI, AsyncQL)
+	double priority_tol = 1e-4; // style 3: a state is requeued when sweeping it moved V by more than this
 	int total_num_threads = 1;  // total number of threads
-	int max_outer_iter = 1;
+	int statewise = 0;          // AsyncQVI update unit: 0 one (state, action) per iteration, 1 all actions of a state, V written once
+	int pin = 0;                // pin solver thread t to CPU t (modulo the CPUs) if 1 (pool.h)
+	int chunk = 64;             // iterations claimed by a thread at once from the global counter (AsyncQVI, AsyncQL)
+	int deterministic = 0;      // fixed schedule: thread t runs chunks t, t+nthreads, ..., chunk c on random stream c (AsyncQVI, AsyncQL)
+	int lockfree = 0;           // shared V and pi update: 0 mutex, 1 lock-free atomic max (AsyncQVI, AsyncQL)
+	std::string store = "";     // AsyncQVI keeps V and pi in this file, mapped instead of held in memory (packed.h); lock-free
+	int store_huge = 0;         // ask for transparent huge pages on the store mapping if 1
+	int store_ahead = 64;       // MB of the store read ahead of the cyclic sweep (style 1), 0 off
+	int numa = 0;               // NUMA shards of AsyncQVI (numa.h): 0 off, 1 one per node, n > 1 n shards; lock-free, not deterministic
+	double numa_local = 0.9;    // share of chunks a NUMA-mode thread sweeps in its own shard
+	long long max_outer_iter = 1;
 	int max_inner_iter = 1;
 	int sample_num_1 = 1;
 	int sample_num_2 = 1;
@@ -32,14 +72,33 @@ struct Params{
 	double alpha = 1.;          // QL learning rate
 	double alpha1 = 0.;         // \alpha_1 in Alg.1, VRQVI
 	double epsilon = 0.;        // monotonic parameter of QVI and VRVI
-	int save = 0;				// save final policy if 1
-	int check_step;			    // how often to check policy
+	int sample_cache = 0;       // MB of oracle draws VRVI and VRQVI keep per (state, action) and reuse (samples.h), 0 off
+	std::string sample_cache_file = "";  // scratch file holding those draws instead of memory if set
+	int simd = -1;              // widest vector kernels used by VRVI and VRQVI: -1 auto, 0 scalar, 1 avx2, 2 avx512
+	int save = 0;				// save final policy: 1 to policy.txt, 2 with V (and Q) to binary policy.bin
+	int save_bytes = 8;         // bytes per V/Q entry in policy.bin: 4 float, 8 double
+	std::string checkpoint = "";  // checkpoint file written at every policy check, none if empty (checkpoint.h)
+	int resume = 0;             // restore the solver from the checkpoint file before running if 1
+	long long check_step;		// how often to check policy
+	double target = 1e100;      // reward target, the time of the first evaluation reaching it is kept in target_time
+	double converge_tol = -1;   // stop AsyncQVI/AsyncQL after converge_sweeps sweeps (len_state*len_action iterations) raising no V by more, off if negative
+	int converge_sweeps = 2;
+	int eval_thread = 0;        // evaluate policy in a dedicated thread without stopping workers if 1 (AsyncQVI, AsyncQL)
+	std::string mdp = "";       // transition table file of a tabular MDP (tabular.h), sailing is solved if empty
 	
 	/* fixed setting */
 	int stop = 0;
-	int threshold = 0;
+	int converged = 0;          // set by the convergence monitor (converge.h)
+	long long threshold = 0;
+	long long start_iter = 1;   // first iteration of this run, later when resumed
+	long long outer = 0;        // next outer iteration of VRVI and VRQVI
 	double time;
-	double test_time = 0;
+	double test_time = 0;       // seconds the solver stood still for evaluations, excluded from its time
+	double eval_time = 0;       // seconds spent in evaluations, also by the -eval_thread evaluator
+	double lock_wait = 0;       // seconds spent waiting for writelock
+	double reward = 0;          // reward of the last evaluation
+	double target_time = -1;    // time when reward first reached target, -1 if not yet
+	long long samples_reused = 0;  // draws served by the sample cache instead of the oracle
 };
 
 // load parameters from makefile
@@ -60,19 +119,23 @@ void parse_input_argv(Params* para, int argc, char *argv[]){
 			return;
 		}
 		else if (std::string(argv[i - 1]) == "-len_state") {
-			para->len_state = atoi(argv[i]);
+			para->len_state = (state_t)atoll(argv[i]);
+			if(para->len_state != atoll(argv[i])){
+				cout << "len_state " << argv[i] << " does not fit in " << sizeof(state_t) << "-byte state indices, rebuild with STATE=64" << endl;
+				exit(1);
+			}
 		}
 		else if (std::string(argv[i - 1]) == "-len_action") {
 			para->len_action = atoi(argv[i]);
 		}
 		else if (std::string(argv[i - 1]) == "-probs") {
 			para->probs = atof(argv[i]);
-		}
-		else if (std::string(argv[i - 1]) == "-d") {
-			para->d = atof(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-d") {
+			para->d = atof(argv[i]);
 		}
 		else if (std::string(argv[i - 1]) == "-max_outer_iter") {
-			para->max_outer_iter = atoi(argv[i]);
+			para->max_outer_iter = atoll(argv[i]);
 		}
 		else if (std::string(argv[i - 1]) == "-max_inner_iter") {
 			para->max_inner_iter = atoi(argv[i]);
@@ -83,6 +146,9 @@ void parse_input_argv(Params* para, int argc, char *argv[]){
 		else if (std::string(argv[i - 1]) == "-test_max_step") {
 			para->test_max_step = atoi(argv[i]);
 		}
+		else if (std::string(argv[i - 1]) == "-eval_threads") {
+			para->eval_threads = atoi(argv[i]);
+		}
 		else if (std::string(argv[i - 1]) == "-sample_num_1") {
 			para->sample_num_1 = atoi(argv[i]);
 		}
@@ -90,7 +156,7 @@ void parse_input_argv(Params* para, int argc, char *argv[]){
 			para->sample_num_2 = atoi(argv[i]);
 		}
 		else if (std::string(argv[i - 1]) == "-check_step") {
-			para->check_step = atoi(argv[i]);
+			para->check_step = atoll(argv[i]);
 		}
 		else if (std::string(argv[i - 1]) == "-style") {
 			para->style = atoi(argv[i]);
@@ -113,12 +179,87 @@ void parse_input_argv(Params* para, int argc, char *argv[]){
 		else if (std::string(argv[i - 1]) == "-epsilon") {
 			para->epsilon = atof(argv[i]);
 		}
+		else if (std::string(argv[i - 1]) == "-save_bytes") {
+			para->save_bytes = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-store") {
+			para->store = argv[i];
+		}
+		else if (std::string(argv[i - 1]) == "-store_huge") {
+			para->store_huge = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-store_ahead") {
+			para->store_ahead = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-sample_cache") {
+			para->sample_cache = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-sample_cache_file") {
+			para->sample_cache_file = argv[i];
+		}
+		else if (std::string(argv[i - 1]) == "-statewise") {
+			para->statewise = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-pin") {
+			para->pin = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-layout") {
+			para->layout = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-converge_tol") {
+			para->converge_tol = atof(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-converge_sweeps") {
+			para->converge_sweeps = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-priority_tol") {
+			para->priority_tol = atof(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-numa") {
+			para->numa = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-numa_local") {
+			para->numa_local = atof(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-checkpoint") {
+			para->checkpoint = argv[i];
+		}
+		else if (std::string(argv[i - 1]) == "-resume") {
+			para->resume = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-target") {
+			para->target = atof(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-seed") {
+			para->seed = atoll(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-deterministic") {
+			para->deterministic = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-fast_rng") {
+			para->fast_rng = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-mdp") {
+			para->mdp = argv[i];
+		}
+		else if (std::string(argv[i - 1]) == "-simd") {
+			para->simd = atoi(argv[i]);
+		}
 		else if (std::string(argv[i - 1]) == "-algo") {
 			para->algo = atoi(argv[i]);
 		}
 		else if (std::string(argv[i - 1]) == "-nthreads") {
 			para->total_num_threads = atoi(argv[i]);
 		}
+		else if (std::string(argv[i - 1]) == "-chunk") {
+			para->chunk = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-eval_thread") {
+			para->eval_thread = atoi(argv[i]);
+		}
+		else if (std::string(argv[i - 1]) == "-lockfree") {
+			para->lockfree = atoi(argv[i]);
+		}
 		else {
 			cout << "Input number error: [2]" << endl;
 			return;
@@ -146,6 +287,13 @@ double normalDouble(double mean, double sd){
 }
 
 
+// access hints of adviseStore
+#define STORE_NORMAL 0
+#define STORE_SEQUENTIAL 1       // read ahead aggressively, pages behind can go first
+#define STORE_RANDOM 2           // no read ahead
+#define STORE_WILLNEED 3         // start reading the range now
+#define STORE_HUGE 4             // back the range with transparent huge pages where the file system allows it
+
 //  Windows
 #ifdef _WIN32
 #include <Windows.h>
@@ -174,11 +322,77 @@ double get_cpu_time(){
     return 0;
   }
 }
+void* alignedMalloc(size_t bytes, size_t alignment){
+  void* p = _aligned_malloc(bytes, alignment);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void alignedFree(void* p){
+  _aligned_free(p);
+}
+// map a whole file read-only, returns NULL on failure
+const void* mapFile(const char* path, size_t* bytes){
+  HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (f == INVALID_HANDLE_VALUE) return NULL;
+  LARGE_INTEGER size;
+  HANDLE m = GetFileSizeEx(f, &size) ? CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  CloseHandle(f);
+  if (!m) return NULL;
+  const void* p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(m);
+  *bytes = (size_t)size.QuadPart;
+  return p;
+}
+void unmapFile(const void* p, size_t bytes){
+  UnmapViewOfFile(p);
+}
+// map path read-write and shared: with keep an existing file of at least bytes, else a new
+// or emptied file grown with zeros to bytes; NULL on failure
+void* mapStore(const char* path, size_t bytes, bool keep){
+  HANDLE f = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, keep ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (f == INVALID_HANDLE_VALUE) return NULL;
+  LARGE_INTEGER size;
+  if (keep && (!GetFileSizeEx(f, &size) || (size_t)size.QuadPart < bytes)){
+    CloseHandle(f);
+    return NULL;
+  }
+  size.QuadPart = (LONGLONG)bytes;
+  HANDLE m = CreateFileMappingA(f, NULL, PAGE_READWRITE, size.HighPart, size.LowPart, NULL);
+  CloseHandle(f);
+  if (!m) return NULL;
+  void* p = MapViewOfFile(m, FILE_MAP_WRITE, 0, 0, bytes);
+  CloseHandle(m);
+  return p;
+}
+// the dirty pages are queued for writing either way, wait is not passed on
+void syncStore(void* p, size_t bytes, bool wait){
+  FlushViewOfFile(p, bytes);
+}
+void unmapStore(void* p, size_t bytes){
+  UnmapViewOfFile(p);
+}
+// access hints are not passed on
+void adviseStore(void* p, size_t bytes, int advice){
+}
+// zeroed pages, physical memory is placed on the node of the first thread writing each page
+void* allocPages(size_t bytes){
+  if (bytes == 0) return NULL;
+  void* p = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void freePages(void* p, size_t bytes){
+  if (p) VirtualFree(p, 0, MEM_RELEASE);
+}
 
 //  Posix/Linux
 #else
 #include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 double get_wall_time(){
   struct timeval time;
   if (gettimeofday(&time,NULL)){
@@ -190,6 +404,97 @@ double get_wall_time(){
 double get_cpu_time(){
   return (double)clock() / CLOCKS_PER_SEC;
 }
+void* alignedMalloc(size_t bytes, size_t alignment){
+  void* p = NULL;
+  if (posix_memalign(&p, alignment, bytes)) throw std::bad_alloc();
+  return p;
+}
+void alignedFree(void* p){
+  free(p);
+}
+// map a whole file read-only, returns NULL on failure
+const void* mapFile(const char* path, size_t* bytes){
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  void* p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return NULL;
+  *bytes = (size_t)st.st_size;
+  return p;
+}
+void unmapFile(const void* p, size_t bytes){
+  munmap((void*)p, bytes);
+}
+// map path read-write and shared: with keep an existing file of at least bytes, else a new
+// or emptied file grown with zeros to bytes; NULL on failure
+void* mapStore(const char* path, size_t bytes, bool keep){
+  int fd = open(path, keep ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return NULL;
+  struct stat st;
+  void* p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && ((size_t)st.st_size >= bytes || (!keep && ftruncate(fd, (off_t)bytes) == 0)))
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? NULL : p;
+}
+// write the dirty pages of [p, p+bytes) back to the file, waiting for the disk if wait, else only scheduling it
+void syncStore(void* p, size_t bytes, bool wait){
+  msync(p, bytes, wait ? MS_SYNC : MS_ASYNC);
+}
+void unmapStore(void* p, size_t bytes){
+  munmap(p, bytes);
+}
+// pass access hint advice (STORE_*) for the pages holding [p, p+bytes) to the kernel
+void adviseStore(void* p, size_t bytes, int advice){
+  int m = MADV_NORMAL;
+  if (advice == STORE_SEQUENTIAL) m = MADV_SEQUENTIAL;
+  else if (advice == STORE_RANDOM) m = MADV_RANDOM;
+  else if (advice == STORE_WILLNEED) m = MADV_WILLNEED;
+#ifdef MADV_HUGEPAGE
+  else if (advice == STORE_HUGE) m = MADV_HUGEPAGE;
 #endif
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  char* lo = (char*)((uintptr_t)p / page * page);
+  madvise(lo, (char*)p + bytes - lo, m);
+}
+// zeroed pages, physical memory is placed on the node of the first thread writing each page
+void* allocPages(size_t bytes){
+  if (bytes == 0) return NULL;
+  void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) throw std::bad_alloc();
+  return p;
+}
+void freePages(void* p, size_t bytes){
+  if (p) munmap(p, bytes);
+}
+#endif
+
+// deleter of alignedArray: destroys the n elements and frees the aligned block
+template <class T>
+struct AlignedArrayDelete{
+	size_t n;
+	void operator()(T* p) const{
+		for(size_t k = 0; k < n; k++)
+			p[k].~T();
+		alignedFree(p);
+	}
+};
+
+template <class T>
+using AlignedArray = std::unique_ptr<T[], AlignedArrayDelete<T> >;
+
+// n default-constructed T aligned to alignof(T), e.g. one per cache line for alignas(64)
+// slots: before C++17 array new ignores alignments above that of max_align_t
+template <class T>
+AlignedArray<T> alignedArray(size_t n){
+	T* p = (T*)alignedMalloc(n * sizeof(T), alignof(T));
+	for(size_t k = 0; k < n; k++)
+		new(p + k) T();
+	AlignedArrayDelete<T> del = {n};
+	return AlignedArray<T>(p, del);
+}
 		
 #endif
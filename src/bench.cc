@@ -0,0 +1,189 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cmath>
+#include "async.h"
+#include "algo.h"
+#include "oracle.h"
+#include "tabular.h"
+#include "run.h"
+#include <time.h>
+using namespace std;
+
+std::atomic<long long> iter(1);    // global iteration counter
+pthread_mutex_t writelock;   // writing lock
+pthread_barrier_t barrier;   // sync barrier
+pthread_barrierattr_t attr;
+
+// random number generator
+std::random_device rd;
+std::mt19937 global_rng(rd());
+
+// result of one benchmark run
+struct BenchResult{
+	int algo;
+	state_t len_state;
+	int threads;
+	double seconds;       // wall time of the run
+	double eval_seconds;  // time spent in evaluations, also when they ran beside the workers (-eval_thread)
+	double stall_seconds; // time the solver stood still for evaluations, excluded from the solver time
+	double calls;         // oracle calls
+	double updates;       // Q/V entry updates
+	double lock_wait;     // seconds waiting for writelock, summed over threads
+	double target_time;   // solver time to the first evaluation reaching params.target, -1 if never
+	double reward;        // reward of the last evaluation
+};
+
+// comma separated integers, e.g. "1,2,4,8"
+std::vector<long long> parse_list(const std::string& text){
+	std::vector<long long> list;
+	std::stringstream ss(text);
+	std::string item;
+	while(std::getline(ss, item, ','))
+		list.push_back(atoll(item.c_str()));
+	return list;
+}
+
+// oracle calls and updates done by a run of params: AsyncQVI/AsyncQL from the iteration
+// count, VRVI/VRQVI from their sample schedule (counts grow x4/x2 per outer iteration)
+void work(const Params& params, long long iters, double* calls, double* updates){
+	double pairs = (double)params.len_state * params.len_action;
+	if(params.algo == 0 || params.algo == 1){
+		*updates = (double)iters;
+		*calls = (double)iters * (params.algo == 0 ? params.max_inner_iter : 1);
+		return;
+	}
+	int growth = params.algo == 2 ? 4 : 2;
+	double n1 = params.sample_num_1, n2 = params.sample_num_2;
+	*calls = 0.;
+	*updates = 0.;
+	for(long long t = 0; t < params.max_outer_iter; t++){
+		*calls += pairs * (n1 + params.max_inner_iter * n2);
+		*updates += pairs * (1 + params.max_inner_iter);
+		n1 *= growth;
+		n2 *= growth;
+	}
+}
+
+// run algo on len_state states with threads threads, evaluation lines are discarded
+BenchResult bench(Params base, int algo, state_t len_state, int threads){
+	Params params = base;
+	params.algo = algo;
+	params.len_state = len_state;
+	params.total_num_threads = threads;
+	std::vector<action_t> pi(params.len_state, 0);
+	iter = 1;
+	pthread_barrier_init(&barrier, &attr, params.total_num_threads);
+
+	std::ofstream null;
+	std::streambuf* out = cout.rdbuf(null.rdbuf());
+	params.time = get_wall_time();
+	if(params.mdp.empty())
+		run<Sailing>(params, pi);
+	else
+		run<TabularMDP>(params, pi);
+	double seconds = get_wall_time() - params.time;
+	finishCheckpoint();
+	cout.rdbuf(out);
+	pthread_barrier_destroy(&barrier);
+
+	BenchResult res;
+	res.algo = algo;
+	res.len_state = len_state;
+	res.threads = threads;
+	res.seconds = seconds;
+	res.eval_seconds = params.eval_time;
+	res.stall_seconds = params.test_time;
+	Params schedule = base;   // sample counts before the run changed them
+	schedule.algo = algo;
+	schedule.len_state = len_state;
+	work(schedule, iter - 1, &res.calls, &res.updates);
+	res.calls -= params.samples_reused;   // draws served by the sample cache (samples.h)
+	res.lock_wait = params.lock_wait;
+	res.target_time = params.target_time;
+	res.reward = params.reward;
+	return res;
+}
+
+void print_csv_header(){
+	cout<<"algo,len_state,threads,seconds,eval_seconds,eval_overhead,oracle_calls,calls_per_sec,"
+	    <<"updates,updates_per_sec,lock_wait,time_to_target,reward"<<endl;
+}
+
+void print_csv(const BenchResult& r){
+	double solve = r.seconds - r.stall_seconds;
+	cout<<r.algo<<','<<r.len_state<<','<<r.threads<<','<<r.seconds<<','<<r.eval_seconds<<','
+	    <<r.stall_seconds/r.seconds<<','<<r.calls<<','<<r.calls/solve<<','<<r.updates<<','
+	    <<r.updates/solve<<','<<r.lock_wait<<','<<r.target_time<<','<<r.reward<<endl;
+}
+
+void print_json(const BenchResult& r, bool last){
+	double solve = r.seconds - r.stall_seconds;
+	cout<<"  {\"algo\": "<<r.algo<<", \"len_state\": "<<r.len_state<<", \"threads\": "<<r.threads
+	    <<", \"seconds\": "<<r.seconds<<", \"eval_seconds\": "<<r.eval_seconds
+	    <<", \"eval_overhead\": "<<r.stall_seconds/r.seconds<<", \"oracle_calls\": "<<r.calls
+	    <<", \"calls_per_sec\": "<<r.calls/solve<<", \"updates\": "<<r.updates
+	    <<", \"updates_per_sec\": "<<r.updates/solve<<", \"lock_wait\": "<<r.lock_wait
+	    <<", \"time_to_target\": "<<r.target_time<<", \"reward\": "<<r.reward<<"}"<<(last ? "" : ",")<<endl;
+}
+
+int main(int argc, char** argv){
+
+	/* Step 0: load the base parameters as for bin/test, plus the sweep:
+	   -bench_algos 0,1,2,3  -bench_threads 1,2,4  -bench_states 80000  -bench_format csv|json */
+	std::vector<long long> algos, threads, states;
+	std::string format = "csv";
+	std::vector<char*> args(1, argv[0]);   // options left for parse_input_argv
+	for (int i = 1; i < argc; i++){
+		std::string key = argv[i];
+		if(i + 1 < argc && key == "-bench_algos")
+			algos = parse_list(argv[++i]);
+		else if(i + 1 < argc && key == "-bench_threads")
+			threads = parse_list(argv[++i]);
+		else if(i + 1 < argc && key == "-bench_states")
+			states = parse_list(argv[++i]);
+		else if(i + 1 < argc && key == "-bench_format")
+			format = argv[++i];
+		else
+			args.push_back(argv[i]);
+	}
+	Params base;
+	parse_input_argv(&base, (int)args.size(), args.data());
+	if(algos.empty())
+		algos.push_back(base.algo);
+	if(threads.empty())
+		threads.push_back(base.total_num_threads);
+	if(states.empty())
+		states.push_back(base.len_state);
+	if(!base.mdp.empty()){
+		// a tabular MDP fixes the number of states
+		TabularMDP::setSize(&base);
+		states.assign(1, base.len_state);
+	}
+
+	/* Step 1: run every (algorithm, states, threads) configuration and report it */
+	if(format == "json")
+		cout<<"["<<endl;
+	else
+		print_csv_header();
+	for (size_t a = 0; a < algos.size(); a++){
+		for (size_t s = 0; s < states.size(); s++){
+			for (size_t t = 0; t < threads.size(); t++){
+				BenchResult r = bench(base, algos[a], states[s], threads[t]);
+				bool last = a + 1 == algos.size() && s + 1 == states.size() && t + 1 == threads.size();
+				if(format == "json")
+					print_json(r, last);
+				else
+					print_csv(r);
+			}
+		}
+	}
+	if(format == "json")
+		cout<<"]"<<endl;
+	return 0;
+}